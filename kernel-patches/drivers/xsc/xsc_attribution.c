@@ -4,11 +4,17 @@
  * Copyright (C) 2025
  *
  * Charges CPU time, IO, memory, PSI stalls, and rlimit checks to the
- * origin (submitting task), not the worker thread.
+ * origin (submitting task), not the worker thread. While a worker runs
+ * an origin's SQEs it also takes on the origin's scheduling policy,
+ * priority, nice and uclamp, so an RT or latency-critical submitter is
+ * not served at the workqueue's priority (xsc.inherit_sched).
  */
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
+#include <linux/sched/rt.h>
+#include <uapi/linux/sched/types.h>
 #include <linux/sched/signal.h>
 #include <linux/cgroup.h>
 #include <linux/resource.h>
@@ -16,9 +22,16 @@
 #include <linux/memcontrol.h>
 #include <linux/blk-cgroup.h>
 #include <linux/audit.h>
+#include <linux/capability.h>
+#include <linux/ioprio.h>
 
 #include "xsc_internal.h"
 
+static bool inherit_sched = true;
+module_param(inherit_sched, bool, 0644);
+MODULE_PARM_DESC(inherit_sched,
+		 "Run each SQE at its origin's policy, priority and uclamp");
+
 /*
  * xsc_task_cred_snapshot - Capture origin task credentials
  * @tc: target credential structure
@@ -106,6 +119,86 @@ struct xsc_attr_guard {
 #endif
 };
 
+static void xsc_sched_attr_of(struct task_struct *p, struct sched_attr *attr)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->sched_policy = READ_ONCE(p->policy);
+	if (rt_policy(attr->sched_policy))
+		attr->sched_priority = READ_ONCE(p->rt_priority);
+	attr->sched_nice = task_nice(p);
+#ifdef CONFIG_UCLAMP_TASK
+	/* -1 resets a clamp the task never set to the system default */
+	attr->sched_flags = SCHED_FLAG_UTIL_CLAMP;
+	attr->sched_util_min = p->uclamp_req[UCLAMP_MIN].user_defined ?
+			       p->uclamp_req[UCLAMP_MIN].value : -1;
+	attr->sched_util_max = p->uclamp_req[UCLAMP_MAX].user_defined ?
+			       p->uclamp_req[UCLAMP_MAX].value : -1;
+#endif
+}
+
+static bool xsc_sched_attr_equal(const struct sched_attr *a,
+				 const struct sched_attr *b)
+{
+	return a->sched_policy == b->sched_policy &&
+	       a->sched_priority == b->sched_priority &&
+	       (rt_policy(a->sched_policy) || a->sched_nice == b->sched_nice) &&
+	       a->sched_util_min == b->sched_util_min &&
+	       a->sched_util_max == b->sched_util_max;
+}
+
+/*
+ * xsc_sched_inherit - Run a worker at the origin's scheduling attributes
+ * @w: the ring worker, before each chain it runs
+ * @origin: submitting task
+ *
+ * Switching costs a sched_setattr() and a requeue, so the worker keeps
+ * what it applied across chains and switches again only when the
+ * origin's attributes change. xsc_sched_restore() gives the kworker its
+ * own back before it returns to the shared pool.
+ */
+void xsc_sched_inherit(struct xsc_worker *w, struct task_struct *origin)
+{
+	struct sched_attr attr;
+
+	if (!READ_ONCE(inherit_sched)) {
+		xsc_sched_restore(w);
+		return;
+	}
+
+	xsc_sched_attr_of(origin, &attr);
+
+	/*
+	 * A worker cannot join a SCHED_DEADLINE reservation; serve such
+	 * origins ahead of every other class short of deadline instead.
+	 */
+	if (attr.sched_policy == SCHED_DEADLINE) {
+		attr.sched_policy = SCHED_FIFO;
+		attr.sched_priority = MAX_RT_PRIO - 1;
+	}
+
+	if (!w->sched_switched) {
+		xsc_sched_attr_of(current, &w->sched_prev);
+		w->sched_cur = w->sched_prev;
+	}
+	if (xsc_sched_attr_equal(&attr, &w->sched_cur))
+		return;
+
+	if (!sched_setattr_nocheck(current, &attr)) {
+		w->sched_cur = attr;
+		w->sched_switched = true;
+	}
+}
+
+void xsc_sched_restore(struct xsc_worker *w)
+{
+	if (!w->sched_switched)
+		return;
+	if (!xsc_sched_attr_equal(&w->sched_cur, &w->sched_prev))
+		sched_setattr_nocheck(current, &w->sched_prev);
+	w->sched_switched = false;
+}
+
 static void xsc_attribution_enter(struct xsc_ctx *ctx,
 				  struct xsc_task_cred *tc,
 				  struct xsc_attr_guard *guard)
@@ -124,7 +217,9 @@ static void xsc_attribution_enter(struct xsc_ctx *ctx,
 #endif
 
 #ifdef CONFIG_CGROUPS
-	if (tc->origin && ctx && ctx->task && tc->origin != current)
+	/* Inline execution already runs in the origin's cgroups */
+	if (tc->origin && ctx && ctx->task &&
+	    !same_thread_group(tc->origin, current))
 		guard->css_switched = !cgroup_attach_task_all(tc->origin, current);
 #endif
 }
@@ -188,3 +283,33 @@ int xsc_check_rlimit(struct xsc_task_cred *tc, unsigned int resource,
 	return 0;
 }
 EXPORT_SYMBOL_GPL(xsc_check_rlimit);
+
+/*
+ * xsc_check_ioprio - Validate an SQE's ioprio against the origin
+ * @tc: credentials snapshot
+ * @ioprio: sqe->ioprio
+ *
+ * Workers are kthreads with every capability, so the RT class check
+ * that ioprio_check_cap() does on current has to use the origin here.
+ *
+ * Returns: 0 if allowed, -EPERM or -EINVAL otherwise
+ */
+int xsc_check_ioprio(struct xsc_task_cred *tc, u16 ioprio)
+{
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_NONE:
+	case IOPRIO_CLASS_IDLE:
+		return 0;
+	case IOPRIO_CLASS_RT:
+		if (!has_capability_noaudit(tc->origin, CAP_SYS_NICE) &&
+		    !has_capability_noaudit(tc->origin, CAP_SYS_ADMIN))
+			return -EPERM;
+		fallthrough;
+	case IOPRIO_CLASS_BE:
+		if (IOPRIO_PRIO_DATA(ioprio) >= IOPRIO_NR_LEVELS)
+			return -EINVAL;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
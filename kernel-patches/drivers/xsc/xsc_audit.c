@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC audit emission (v8-D §5.4)
+ * Copyright (C) 2025
+ *
+ * Emits one record when an SQE is consumed and one with its result,
+ * carrying the origin task's identity from the attribution snapshot.
+ * The worker only calls in here when xsc_audit_key is enabled, so hosts
+ * without audit pay a patched-out branch per op.
+ *
+ * In summary mode, high-volume data-path ops (read/write/pread/pwrite/
+ * readv/writev/send/recv) are not audited one by one. They are folded
+ * into per-interval summary records keyed by fd, opcode and cgroup, with
+ * an optional 1-in-N sample still audited individually. Everything else
+ * (open, execve, connect, bind, ...) is always audited per op.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/audit.h>
+#include <linux/jump_label.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/workqueue.h>
+
+#include "xsc_internal.h"
+
+/* Not assigned upstream; kept clear of the 13xx types in use */
+#ifndef AUDIT_XSC_SUBMIT
+#define AUDIT_XSC_SUBMIT	1360	/* XSC SQE consumed */
+#define AUDIT_XSC_RESULT	1361	/* XSC SQE completed */
+#define AUDIT_XSC_SUMMARY	1362	/* XSC data-path ops, aggregated */
+#endif
+
+DEFINE_STATIC_KEY_FALSE(xsc_audit_key);
+EXPORT_SYMBOL_GPL(xsc_audit_key);
+
+static bool xsc_audit_param;
+
+static int xsc_audit_param_set(const char *val, const struct kernel_param *kp)
+{
+	int ret;
+
+	ret = param_set_bool(val, kp);
+	if (ret)
+		return ret;
+
+	if (xsc_audit_param)
+		static_branch_enable(&xsc_audit_key);
+	else
+		static_branch_disable(&xsc_audit_key);
+	return 0;
+}
+
+static const struct kernel_param_ops xsc_audit_param_ops = {
+	.set	= xsc_audit_param_set,
+	.get	= param_get_bool,
+};
+module_param_cb(audit, &xsc_audit_param_ops, &xsc_audit_param, 0644);
+MODULE_PARM_DESC(audit, "Emit per-SQE audit records (default: follows audit_enabled at load)");
+
+enum {
+	XSC_AUDIT_MODE_FULL,
+	XSC_AUDIT_MODE_SUMMARY,
+};
+
+static int xsc_audit_mode = XSC_AUDIT_MODE_FULL;
+
+static int xsc_audit_mode_set(const char *val, const struct kernel_param *kp)
+{
+	if (sysfs_streq(val, "full"))
+		WRITE_ONCE(xsc_audit_mode, XSC_AUDIT_MODE_FULL);
+	else if (sysfs_streq(val, "summary"))
+		WRITE_ONCE(xsc_audit_mode, XSC_AUDIT_MODE_SUMMARY);
+	else
+		return -EINVAL;
+	return 0;
+}
+
+static int xsc_audit_mode_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%s\n", READ_ONCE(xsc_audit_mode) ==
+		       XSC_AUDIT_MODE_SUMMARY ? "summary" : "full");
+}
+
+static const struct kernel_param_ops xsc_audit_mode_ops = {
+	.set	= xsc_audit_mode_set,
+	.get	= xsc_audit_mode_get,
+};
+module_param_cb(audit_mode, &xsc_audit_mode_ops, NULL, 0644);
+MODULE_PARM_DESC(audit_mode, "full: audit every op; summary: aggregate data-path ops");
+
+static unsigned int audit_sample;
+module_param(audit_sample, uint, 0644);
+MODULE_PARM_DESC(audit_sample, "In summary mode, also audit 1 in N data-path ops individually (0: none)");
+
+static unsigned int audit_interval_ms = 1000;
+module_param(audit_interval_ms, uint, 0644);
+MODULE_PARM_DESC(audit_interval_ms, "Summary record interval in milliseconds");
+
+/*
+ * Per-ring aggregation table. Small and open-addressed: a ring that
+ * touches more distinct (fd, op, cgroup) keys within one interval than
+ * fit simply flushes early.
+ */
+#define XSC_AUDIT_AGG_BITS	6
+#define XSC_AUDIT_AGG_SLOTS	(1 << XSC_AUDIT_AGG_BITS)
+
+struct xsc_audit_slot {
+	u64			cgroup_id;
+	u64			count;
+	u64			bytes;
+	u64			errors;
+	s32			fd;
+	pid_t			tgid;
+	kuid_t			uid;
+	u8			opcode;
+	bool			used;
+};
+
+struct xsc_audit_agg {
+	spinlock_t		lock;
+	struct xsc_ctx		*ctx;
+	struct delayed_work	flush_work;
+	atomic_t		sample_seq;
+	u64			start_ns;
+	struct xsc_audit_slot	slot[XSC_AUDIT_AGG_SLOTS];
+};
+
+static bool xsc_audit_is_data_op(u8 opcode)
+{
+	switch (opcode) {
+	case XSC_OP_READ:
+	case XSC_OP_WRITE:
+	case XSC_OP_PREAD:
+	case XSC_OP_PWRITE:
+	case XSC_OP_READV:
+	case XSC_OP_WRITEV:
+	case XSC_OP_SENDTO:
+	case XSC_OP_SEND_ZC:
+	case XSC_OP_RECVFROM:
+	case XSC_OP_SENDMSG:
+	case XSC_OP_RECVMSG:
+	case XSC_OP_SENDMMSG:
+	case XSC_OP_RECVMMSG:
+	case XSC_OP_SPLICE:
+	case XSC_OP_TEE:
+	case XSC_OP_SENDFILE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Emit and clear all slots; caller holds agg->lock */
+static void xsc_audit_flush_locked(struct xsc_audit_agg *agg)
+{
+	u64 interval_ms = div_u64(ktime_get_ns() - agg->start_ns, NSEC_PER_MSEC);
+	struct audit_buffer *ab;
+	int i;
+
+	for (i = 0; i < XSC_AUDIT_AGG_SLOTS; i++) {
+		struct xsc_audit_slot *sl = &agg->slot[i];
+
+		if (!sl->used)
+			continue;
+
+		ab = audit_log_start(NULL, GFP_ATOMIC, AUDIT_XSC_SUMMARY);
+		if (ab) {
+			audit_log_format(ab,
+					 "ring=%u tgid=%d uid=%u cgroup=%llu nr=%u fd=%d count=%llu bytes=%llu errors=%llu interval_ms=%llu",
+					 agg->ctx->id, sl->tgid,
+					 from_kuid(&init_user_ns, sl->uid),
+					 sl->cgroup_id, sl->opcode, sl->fd,
+					 sl->count, sl->bytes, sl->errors,
+					 interval_ms);
+			audit_log_end(ab);
+		}
+		sl->used = false;
+	}
+	agg->start_ns = ktime_get_ns();
+}
+
+static void xsc_audit_flush_work(struct work_struct *work)
+{
+	struct xsc_audit_agg *agg =
+		container_of(to_delayed_work(work), struct xsc_audit_agg,
+			     flush_work);
+
+	spin_lock_bh(&agg->lock);
+	xsc_audit_flush_locked(agg);
+	spin_unlock_bh(&agg->lock);
+}
+
+static struct xsc_audit_agg *xsc_audit_agg_get(struct xsc_ctx *ctx)
+{
+	struct xsc_audit_agg *agg = READ_ONCE(ctx->audit_agg);
+
+	if (likely(agg))
+		return agg;
+
+	agg = kzalloc(sizeof(*agg), GFP_KERNEL);
+	if (!agg)
+		return NULL;
+	spin_lock_init(&agg->lock);
+	agg->ctx = ctx;
+	agg->start_ns = ktime_get_ns();
+	INIT_DELAYED_WORK(&agg->flush_work, xsc_audit_flush_work);
+
+	if (cmpxchg(&ctx->audit_agg, NULL, agg)) {
+		kfree(agg);
+		agg = ctx->audit_agg;
+	}
+	return agg;
+}
+
+/*
+ * xsc_audit_classify - Decide how an SQE is audited
+ *
+ * Returns XSC_AUDIT_RECORD for a per-op record pair, or
+ * XSC_AUDIT_SUMMARY when the op is folded into the ring's summary.
+ */
+int xsc_audit_classify(struct xsc_ctx *ctx, const struct xsc_sqe *sqe)
+{
+	struct xsc_audit_agg *agg;
+	unsigned int n;
+
+	if (READ_ONCE(xsc_audit_mode) != XSC_AUDIT_MODE_SUMMARY ||
+	    !xsc_audit_is_data_op(sqe->opcode))
+		return XSC_AUDIT_RECORD;
+
+	agg = xsc_audit_agg_get(ctx);
+	if (!agg)
+		return XSC_AUDIT_RECORD;
+
+	n = READ_ONCE(audit_sample);
+	if (n && (unsigned int)atomic_inc_return(&agg->sample_seq) % n == 0)
+		return XSC_AUDIT_RECORD;
+
+	return XSC_AUDIT_SUMMARY;
+}
+
+/*
+ * xsc_audit_account - Fold a completed data-path op into the summary
+ */
+void xsc_audit_account(struct xsc_ctx *ctx, struct xsc_task_cred *tc,
+		       const struct xsc_sqe *sqe, s64 ret)
+{
+	struct xsc_audit_agg *agg = ctx->audit_agg;
+	struct xsc_audit_slot *sl;
+	u32 h, i;
+
+	if (!audit_enabled || !agg)
+		return;
+
+	h = hash_64(tc->cgroup_id ^ ((u64)(u32)sqe->fd << 8) ^ sqe->opcode,
+		    XSC_AUDIT_AGG_BITS);
+
+	spin_lock_bh(&agg->lock);
+	for (i = 0; i < XSC_AUDIT_AGG_SLOTS; i++) {
+		sl = &agg->slot[(h + i) & (XSC_AUDIT_AGG_SLOTS - 1)];
+		if (!sl->used ||
+		    (sl->fd == sqe->fd && sl->opcode == sqe->opcode &&
+		     sl->cgroup_id == tc->cgroup_id))
+			break;
+	}
+	if (i == XSC_AUDIT_AGG_SLOTS) {
+		/* Table full: emit what we have and start over */
+		xsc_audit_flush_locked(agg);
+		sl = &agg->slot[h];
+	}
+
+	if (!sl->used) {
+		memset(sl, 0, sizeof(*sl));
+		sl->used = true;
+		sl->fd = sqe->fd;
+		sl->opcode = sqe->opcode;
+		sl->cgroup_id = tc->cgroup_id;
+		sl->tgid = tc->tgid;
+		sl->uid = tc->uid;
+	}
+	sl->count++;
+	if (ret > 0)
+		sl->bytes += ret;
+	else if (ret < 0)
+		sl->errors++;
+	spin_unlock_bh(&agg->lock);
+
+	if (!delayed_work_pending(&agg->flush_work))
+		schedule_delayed_work(&agg->flush_work,
+				      msecs_to_jiffies(max(audit_interval_ms, 1U)));
+}
+
+/*
+ * xsc_audit_ring_release - Flush and free a ring's summary state
+ */
+void xsc_audit_ring_release(struct xsc_ctx *ctx)
+{
+	struct xsc_audit_agg *agg = ctx->audit_agg;
+
+	if (!agg)
+		return;
+
+	cancel_delayed_work_sync(&agg->flush_work);
+	spin_lock_bh(&agg->lock);
+	xsc_audit_flush_locked(agg);
+	spin_unlock_bh(&agg->lock);
+	kfree(agg);
+	ctx->audit_agg = NULL;
+}
+
+/*
+ * xsc_audit_init - Arm the audit path if auditing is already on
+ *
+ * Called from module init. Turning audit on later requires writing
+ * the "audit" parameter, which keeps the hot path free of a load of
+ * audit_enabled on every op.
+ */
+void xsc_audit_init(void)
+{
+	if (audit_enabled && !xsc_audit_param) {
+		xsc_audit_param = true;
+		static_branch_enable(&xsc_audit_key);
+	}
+}
+
+void xsc_audit_submit(struct xsc_task_cred *tc, u64 nr, u64 *args)
+{
+	struct audit_buffer *ab;
+
+	if (!audit_enabled || !tc->audit_ctx)
+		return;
+
+	ab = audit_log_start(tc->audit_ctx, GFP_KERNEL, AUDIT_XSC_SUBMIT);
+	if (!ab)
+		return;
+
+	audit_log_format(ab,
+			 "pid=%d tgid=%d uid=%u gid=%u cgroup=%llu nr=%llu a0=%llx a1=%llx a2=%llx a3=%llx a4=%llx a5=%llx",
+			 tc->pid, tc->tgid,
+			 from_kuid(&init_user_ns, tc->uid),
+			 from_kgid(&init_user_ns, tc->gid),
+			 tc->cgroup_id, nr,
+			 args[0], args[1], args[2], args[3], args[4], args[5]);
+	audit_log_end(ab);
+}
+EXPORT_SYMBOL_GPL(xsc_audit_submit);
+
+void xsc_audit_result(struct xsc_task_cred *tc, s64 ret)
+{
+	struct audit_buffer *ab;
+
+	if (!audit_enabled || !tc->audit_ctx)
+		return;
+
+	ab = audit_log_start(tc->audit_ctx, GFP_KERNEL, AUDIT_XSC_RESULT);
+	if (!ab)
+		return;
+
+	audit_log_format(ab, "pid=%d tgid=%d success=%s exit=%lld",
+			 tc->pid, tc->tgid, ret >= 0 ? "yes" : "no", ret);
+	audit_log_end(ab);
+}
+EXPORT_SYMBOL_GPL(xsc_audit_result);
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC provided buffers
+ * Copyright (C) 2025
+ *
+ * A receive that may complete many times, or long after submission, does
+ * not want a buffer fixed in its SQE. Userspace instead hands the ring
+ * groups of buffers (XSC_IOC_PROVIDE_BUFFERS), and an SQE with
+ * XSC_F_BUFFER_SELECT takes one from sqe->buf_group only when data is
+ * there to fill it. The CQE names the buffer used (XSC_CQE_F_BUFFER, id
+ * in the upper 16 bits of cqe->flags); it belongs to userspace again
+ * until provided anew. An op finding its group empty fails -ENOBUFS.
+ */
+
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/xarray.h>
+#include <linux/uaccess.h>
+
+#include "xsc_internal.h"
+
+/* Buffer ids are 16 bits, so is a group's size */
+#define XSC_MAX_GROUP_BUFS	(1U << 16)
+
+/*
+ * A group is one array used as a stack: the buffer provided or given
+ * back last is taken first, while its lines may still be in cache. The
+ * array always has room for the buffers taken out, so giving one back
+ * never needs to allocate.
+ */
+struct xsc_buf_group {
+	struct xsc_buf		*bufs;
+	u32			nr;		/* available, bufs[0..nr) */
+	u32			out;		/* taken, not yet used or back */
+	u32			size;		/* of bufs */
+};
+
+static int xsc_buf_group_grow(struct xsc_buf_group *g, u32 need)
+{
+	struct xsc_buf *bufs;
+	u32 size;
+
+	if (need <= g->size)
+		return 0;
+	size = min_t(u32, roundup_pow_of_two(need), XSC_MAX_GROUP_BUFS);
+	bufs = kvmalloc_array(size, sizeof(*bufs), GFP_KERNEL_ACCOUNT);
+	if (!bufs)
+		return -ENOMEM;
+	memcpy(bufs, g->bufs, g->nr * sizeof(*bufs));
+	kvfree(g->bufs);
+	g->bufs = bufs;
+	g->size = size;
+	return 0;
+}
+
+/*
+ * xsc_provide_buffers - Add buffers to a group, creating it if needed
+ * @ctx: ring context
+ * @arg: user pointer to struct xsc_buf_reg
+ *
+ * The nr buffers of len bytes each lie back to back from addr and get
+ * ids bid, bid + 1, ..., taken in that order. A ring has at most
+ * XSC_MAX_BUF_GROUPS groups.
+ */
+int xsc_provide_buffers(struct xsc_ctx *ctx, void __user *arg)
+{
+	struct xsc_buf_group *g, *new = NULL;
+	struct xsc_buf_reg reg;
+	struct xsc_buf *buf;
+	int ret = 0;
+	u32 i;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (!reg.nr || !reg.len || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+	if ((u32)reg.bid + reg.nr > XSC_MAX_GROUP_BUFS)
+		return -EINVAL;
+	if (!access_ok(u64_to_user_ptr(reg.addr), (u64)reg.len * reg.nr))
+		return -EFAULT;
+
+	mutex_lock(&ctx->buf_lock);
+	g = xa_load(&ctx->buf_groups, reg.bgid);
+	if (!g) {
+		if (ctx->nr_buf_groups >= XSC_MAX_BUF_GROUPS) {
+			ret = -ENOSPC;
+			goto unlock;
+		}
+		new = kzalloc(sizeof(*new), GFP_KERNEL_ACCOUNT);
+		if (!new) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		g = new;
+	}
+	if (g->nr + g->out + reg.nr > XSC_MAX_GROUP_BUFS) {
+		ret = -EOVERFLOW;
+		goto unlock;
+	}
+	ret = xsc_buf_group_grow(g, g->nr + g->out + reg.nr);
+	if (ret)
+		goto unlock;
+	if (new) {
+		ret = xa_err(xa_store(&ctx->buf_groups, reg.bgid, new,
+				      GFP_KERNEL_ACCOUNT));
+		if (ret)
+			goto unlock;
+		ctx->nr_buf_groups++;
+		new = NULL;
+	}
+
+	/* Lowest id on top */
+	for (i = reg.nr; i--; ) {
+		buf = &g->bufs[g->nr++];
+		buf->addr = reg.addr + (u64)reg.len * i;
+		buf->len = reg.len;
+		buf->bid = reg.bid + i;
+	}
+unlock:
+	mutex_unlock(&ctx->buf_lock);
+	if (new) {
+		kvfree(new->bufs);
+		kfree(new);
+	}
+	return ret;
+}
+
+/*
+ * xsc_buf_select - Take a buffer from group @bgid into @buf
+ *
+ * Returns false if the group is empty or does not exist. Once the CQE
+ * naming the buffer is posted, the caller reports it used with
+ * xsc_buf_consumed(); if nothing was put in it, xsc_buf_recycle() gives
+ * it back.
+ */
+bool xsc_buf_select(struct xsc_ctx *ctx, u16 bgid, struct xsc_buf *buf)
+{
+	struct xsc_buf_group *g;
+	bool ok = false;
+
+	mutex_lock(&ctx->buf_lock);
+	g = xa_load(&ctx->buf_groups, bgid);
+	if (g && g->nr) {
+		*buf = g->bufs[--g->nr];
+		g->out++;
+		ok = true;
+	}
+	mutex_unlock(&ctx->buf_lock);
+	return ok;
+}
+
+/* Unused: on top again, its contents are still cache-warm */
+void xsc_buf_recycle(struct xsc_ctx *ctx, u16 bgid, const struct xsc_buf *buf)
+{
+	struct xsc_buf_group *g;
+
+	mutex_lock(&ctx->buf_lock);
+	g = xa_load(&ctx->buf_groups, bgid);
+	g->bufs[g->nr++] = *buf;
+	g->out--;
+	mutex_unlock(&ctx->buf_lock);
+}
+
+/* Named in a CQE: it belongs to userspace until provided again */
+void xsc_buf_consumed(struct xsc_ctx *ctx, u16 bgid)
+{
+	struct xsc_buf_group *g;
+
+	mutex_lock(&ctx->buf_lock);
+	g = xa_load(&ctx->buf_groups, bgid);
+	g->out--;
+	mutex_unlock(&ctx->buf_lock);
+}
+
+void xsc_buf_release(struct xsc_ctx *ctx)
+{
+	struct xsc_buf_group *g;
+	unsigned long bgid;
+
+	xa_for_each(&ctx->buf_groups, bgid, g) {
+		kvfree(g->bufs);
+		kfree(g);
+	}
+	xa_destroy(&ctx->buf_groups);
+	ctx->nr_buf_groups = 0;
+}
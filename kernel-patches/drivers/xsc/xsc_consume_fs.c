@@ -16,19 +16,333 @@
 #include <linux/stat.h>
 #include <linux/uio.h>
 #include <linux/string.h>
+#include <linux/splice.h>
+#include <linux/sizes.h>
 #include "xsc_internal.h"
 
-static struct file *xsc_fget(struct files_struct *files, unsigned int fd)
+/*
+ * Ends whose f_pos the op moves are locked as fdget_pos() locks them for
+ * read(2) and write(2), so concurrent users of the file see each step's
+ * update whole. Two different files are taken in address order; the
+ * same file twice only once. Calling it again with the same array takes
+ * the same locks.
+ */
+static void xsc_pos_lock(struct file **lk)
 {
-	struct file *file;
+	if (lk[0] && lk[0] == lk[1])
+		lk[1] = NULL;
+	if (lk[0] && lk[1] && lk[0] > lk[1])
+		swap(lk[0], lk[1]);
+	if (lk[0])
+		mutex_lock(&lk[0]->f_pos_lock);
+	if (lk[1])
+		mutex_lock_nested(&lk[1]->f_pos_lock, SINGLE_DEPTH_NESTING);
+}
+
+static void xsc_pos_unlock(struct file **lk)
+{
+	if (lk[1])
+		mutex_unlock(&lk[1]->f_pos_lock);
+	if (lk[0])
+		mutex_unlock(&lk[0]->f_pos_lock);
+}
+
+static struct file *xsc_pos_file(struct file *file, loff_t *ppos)
+{
+	return !ppos && (file->f_mode & FMODE_ATOMIC_POS) ? file : NULL;
+}
+
+/*
+ * Read/write through a kiocb carrying the SQE's ioprio, so it reaches
+ * the block layer (ki_ioprio -> bio) as it does for preadv2(). Files
+ * with only ->read or ->write take vfs_iter_read()/vfs_iter_write(),
+ * without it. A NULL @ppos is the file position, under its lock.
+ */
+static ssize_t xsc_rw_iter(struct file *file, const struct xsc_sqe *sqe,
+			   int rw, struct iov_iter *iter, loff_t *ppos)
+{
+	struct file *lk[2] = { xsc_pos_file(file, ppos), NULL };
+	struct kiocb kiocb;
+	ssize_t ret;
+	loff_t pos;
+
+	xsc_pos_lock(lk);
+	pos = ppos ? *ppos : file->f_pos;
+
+	if (rw == READ && !file->f_op->read_iter) {
+		ret = vfs_iter_read(file, iter, &pos, 0);
+	} else if (rw == WRITE && !file->f_op->write_iter) {
+		file_start_write(file);
+		ret = vfs_iter_write(file, iter, &pos, 0);
+		file_end_write(file);
+	} else {
+		init_sync_kiocb(&kiocb, file);
+		kiocb.ki_pos = pos;
+		if (sqe->ioprio)
+			kiocb.ki_ioprio = sqe->ioprio;
+
+		if (rw == READ) {
+			ret = vfs_iocb_iter_read(file, &kiocb, iter);
+		} else {
+			file_start_write(file);
+			ret = vfs_iocb_iter_write(file, &kiocb, iter);
+			file_end_write(file);
+		}
+		pos = kiocb.ki_pos;
+	}
+
+	if (ret > 0) {
+		if (ppos)
+			*ppos = pos;
+		else
+			file->f_pos = pos;
+	}
+	xsc_pos_unlock(lk);
+	return ret;
+}
 
-	rcu_read_lock();
-	file = files_lookup_fd_rcu(files, fd);
-	if (file && !get_file_rcu(file))
-		file = NULL;
-	rcu_read_unlock();
+static ssize_t xsc_rw(struct file *file, const struct xsc_sqe *sqe, int rw,
+		      loff_t *ppos)
+{
+	struct iov_iter iter;
+	int ret;
+
+	ret = import_ubuf(rw, u64_to_user_ptr(sqe->addr), sqe->len, &iter);
+	if (ret)
+		return ret;
+	return xsc_rw_iter(file, sqe, rw, &iter, ppos);
+}
 
-	return file;
+/* -1 is "the file position"; anything else is an explicit offset */
+static loff_t *xsc_splice_off(u64 off, loff_t *pos)
+{
+	if (off == (u64)-1)
+		return NULL;
+	*pos = off;
+	return pos;
+}
+
+/*
+ * XSC_OP_SPLICE and XSC_OP_TEE. One side must be a pipe, as for the
+ * syscalls; neither needs the origin's mm, no user memory is touched.
+ */
+static long xsc_splice(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	u32 flags = sqe->splice_flags;
+	loff_t off_in, off_out;
+	struct file *in, *out;
+	long ret;
+
+	if (flags & ~(SPLICE_F_ALL | XSC_SPLICE_F_FD_IN_FIXED))
+		return -EINVAL;
+	flags &= SPLICE_F_ALL;
+
+	in = xsc_get_file_in(ctx, sqe);
+	if (IS_ERR(in))
+		return PTR_ERR(in);
+	out = xsc_get_file(ctx, sqe);
+	if (!out) {
+		fput(in);
+		return -EBADF;
+	}
+
+	if (sqe->opcode == XSC_OP_TEE)
+		ret = sqe->off || sqe->splice_off_in ? -EINVAL :
+		      do_tee(in, out, sqe->len, flags);
+	else
+		ret = do_splice(in, xsc_splice_off(sqe->splice_off_in, &off_in),
+				out, xsc_splice_off(sqe->off, &off_out),
+				sqe->len, flags);
+
+	fput(out);
+	fput(in);
+	return ret;
+}
+
+/*
+ * XSC_OP_SENDFILE - sendfile(2): file (or anything that splices out) to
+ * fd through the internal pipe, with the syscall's checks.
+ */
+static long xsc_sendfile(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	size_t count = min_t(size_t, sqe->len, MAX_RW_COUNT);
+	struct file *in, *out;
+	loff_t *ppos, pos, out_pos;
+	long ret;
+
+	if (sqe->splice_flags & ~XSC_SPLICE_F_FD_IN_FIXED)
+		return -EINVAL;
+
+	in = xsc_get_file_in(ctx, sqe);
+	if (IS_ERR(in))
+		return PTR_ERR(in);
+	out = xsc_get_file(ctx, sqe);
+	if (!out) {
+		ret = -EBADF;
+		goto out_in;
+	}
+
+	ret = -EBADF;
+	if (!(in->f_mode & FMODE_READ) || !(out->f_mode & FMODE_WRITE))
+		goto out;
+	ppos = xsc_splice_off(sqe->splice_off_in, &pos);
+	if (ppos) {
+		ret = -ESPIPE;
+		if (!(in->f_mode & FMODE_PREAD))
+			goto out;
+	} else {
+		pos = in->f_pos;
+	}
+
+	ret = rw_verify_area(READ, in, &pos, count);
+	if (ret < 0)
+		goto out;
+	out_pos = out->f_pos;
+	ret = rw_verify_area(WRITE, out, &out_pos, count);
+	if (ret < 0)
+		goto out;
+
+	file_start_write(out);
+	ret = do_splice_direct(in, &pos, out, &out_pos, count, 0);
+	file_end_write(out);
+
+	if (ret > 0) {
+		if (!ppos)
+			in->f_pos = pos;
+		out->f_pos = out_pos;
+	}
+out:
+	fput(out);
+out_in:
+	fput(in);
+	return ret;
+}
+
+/* Cancellation is checked between steps, so keep them short */
+#define XSC_COPY_STEP	SZ_16M
+
+/*
+ * XSC_OP_COPY_FILE_RANGE and XSC_OP_CLONE_RANGE, in steps. A cancel lands
+ * between two steps (or interrupts one waiting); what was done so far is
+ * reported by the progress CQEs already posted, and a failure posts the
+ * progress since the last one before its error. Clones remap whole
+ * blocks, so a CLONE_RANGE progress interval must be a multiple of the
+ * destination's block size.
+ */
+static long xsc_copy_range(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	bool clone = sqe->opcode == XSC_OP_CLONE_RANGE;
+	u64 left = sqe->copy_len;
+	loff_t pos_in, pos_out;
+	loff_t *ppos_in, *ppos_out;
+	struct file *in, *out, *lk[2];
+	size_t every, since = 0;
+	long ret = 0;
+
+	if (sqe->splice_flags & ~XSC_SPLICE_F_FD_IN_FIXED)
+		return -EINVAL;
+	if (!left && !clone)
+		return 0;
+	every = sqe->len ? min_t(size_t, sqe->len, MAX_RW_COUNT) : MAX_RW_COUNT;
+
+	in = xsc_get_file_in(ctx, sqe);
+	if (IS_ERR(in))
+		return PTR_ERR(in);
+	out = xsc_get_file(ctx, sqe);
+	if (!out) {
+		fput(in);
+		return -EBADF;
+	}
+
+	if (clone) {
+		unsigned int bs = i_blocksize(file_inode(out));
+
+		if (!IS_ALIGNED(sqe->len, bs)) {
+			ret = -EINVAL;
+			goto out_put;
+		}
+		every = round_down(every, bs);
+	}
+
+	ppos_in = xsc_splice_off(sqe->splice_off_in, &pos_in);
+	ppos_out = xsc_splice_off(sqe->off, &pos_out);
+	lk[0] = xsc_pos_file(in, ppos_in);
+	lk[1] = xsc_pos_file(out, ppos_out);
+
+	/* To EOF: one remap, nothing to report progress on */
+	if (clone && !left) {
+		xsc_pos_lock(lk);
+		if (!ppos_in)
+			pos_in = in->f_pos;
+		if (!ppos_out)
+			pos_out = out->f_pos;
+		ret = vfs_clone_file_range(in, pos_in, out, pos_out, 0, 0);
+		xsc_pos_unlock(lk);
+		if (ret > 0)
+			ret = 0;
+		goto out_put;
+	}
+
+	while (left) {
+		size_t step = min_t(u64, left, min_t(size_t, XSC_COPY_STEP,
+						     every - since));
+
+		/* Per step, so the owner's read(2) or lseek(2) waits one */
+		xsc_pos_lock(lk);
+		if (!ppos_in)
+			pos_in = in->f_pos;
+		if (!ppos_out)
+			pos_out = out->f_pos;
+		if (clone)
+			ret = vfs_clone_file_range(in, pos_in, out, pos_out,
+						   step, 0);
+		else
+			ret = vfs_copy_file_range(in, pos_in, out, pos_out,
+						  step, 0);
+		if (ret > 0) {
+			if (!ppos_in)
+				in->f_pos = pos_in + ret;
+			if (!ppos_out)
+				out->f_pos = pos_out + ret;
+		}
+		xsc_pos_unlock(lk);
+		if (ret <= 0)
+			break;
+
+		pos_in += ret;
+		pos_out += ret;
+		left -= ret;
+		since += ret;
+
+		/*
+		 * A short clone is EOF. A copy may come back short anywhere
+		 * (server-side copy, the splice fallback, filesystem chunk
+		 * limits): only a 0 return is EOF.
+		 */
+		if (clone && (size_t)ret < step)
+			break;
+		if (!left)
+			break;
+		if (since == every) {
+			xsc_post_cqe(ctx, sqe->opcode, sqe->user_data, since,
+				     XSC_CQE_F_MORE);
+			since = 0;
+		}
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+	if (ret >= 0)
+		ret = since;
+	else if (since)
+		xsc_post_cqe(ctx, sqe->opcode, sqe->user_data, since,
+			     XSC_CQE_F_MORE);
+out_put:
+	fput(out);
+	fput(in);
+	return ret;
 }
 
 int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cqe)
@@ -42,17 +356,15 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		return 0;
 
 	case XSC_OP_READ: {
-		void __user *buf = (void __user *)sqe->addr;
-
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
-			kthread_use_mm(mm);
-			ret = kernel_read(file, buf, sqe->len, &file->f_pos);
-			kthread_unuse_mm(mm);
+			xsc_use_mm(mm);
+			ret = xsc_rw(file, sqe, READ, NULL);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -62,17 +374,15 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 	}
 
 	case XSC_OP_WRITE: {
-		void __user *buf = (void __user *)sqe->addr;
-
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
-			kthread_use_mm(mm);
-			ret = kernel_write(file, buf, sqe->len, &file->f_pos);
-			kthread_unuse_mm(mm);
+			xsc_use_mm(mm);
+			ret = xsc_rw(file, sqe, WRITE, NULL);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -83,17 +393,16 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 
 	case XSC_OP_PREAD: {
 		loff_t pos = sqe->off;
-		void __user *buf = (void __user *)sqe->addr;
 
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
-			kthread_use_mm(mm);
-			ret = kernel_read(file, buf, sqe->len, &pos);
-			kthread_unuse_mm(mm);
+			xsc_use_mm(mm);
+			ret = xsc_rw(file, sqe, READ, &pos);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -104,17 +413,16 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 
 	case XSC_OP_PWRITE: {
 		loff_t pos = sqe->off;
-		void __user *buf = (void __user *)sqe->addr;
 
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
-			kthread_use_mm(mm);
-			ret = kernel_write(file, buf, sqe->len, &pos);
-			kthread_unuse_mm(mm);
+			xsc_use_mm(mm);
+			ret = xsc_rw(file, sqe, WRITE, &pos);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -127,20 +435,20 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		struct iovec __user *iov = (struct iovec __user *)sqe->addr;
 		unsigned long nr_segs = sqe->len;
 
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
 			struct iov_iter iter;
-			kthread_use_mm(mm);
+			xsc_use_mm(mm);
 			ret = import_iovec(READ, iov, nr_segs, 0, (struct iovec **)&iov, &iter);
 			if (ret >= 0) {
-				ret = vfs_iter_read(file, &iter, &file->f_pos, 0);
+				ret = xsc_rw_iter(file, sqe, READ, &iter, NULL);
 				kfree(iov);
 			}
-			kthread_unuse_mm(mm);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -153,20 +461,20 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		struct iovec __user *iov = (struct iovec __user *)sqe->addr;
 		unsigned long nr_segs = sqe->len;
 
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
 		mm = get_task_mm(ctx->task);
 		if (mm) {
 			struct iov_iter iter;
-			kthread_use_mm(mm);
+			xsc_use_mm(mm);
 			ret = import_iovec(WRITE, iov, nr_segs, 0, (struct iovec **)&iov, &iter);
 			if (ret >= 0) {
-				ret = vfs_iter_write(file, &iter, &file->f_pos, 0);
+				ret = xsc_rw_iter(file, sqe, WRITE, &iter, NULL);
 				kfree(iov);
 			}
-			kthread_unuse_mm(mm);
+			xsc_unuse_mm(mm);
 			mmput(mm);
 		} else {
 			ret = -EINVAL;
@@ -185,7 +493,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		if (!mm)
 			return -EINVAL;
 
-		kthread_use_mm(mm);
+		xsc_use_mm(mm);
 		tmp = getname(filename);
 		if (IS_ERR(tmp)) {
 			ret = PTR_ERR(tmp);
@@ -193,13 +501,16 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 			ret = do_sys_open(AT_FDCWD, tmp->name, flags, mode);
 			putname(tmp);
 		}
-		kthread_unuse_mm(mm);
+		xsc_unuse_mm(mm);
 		mmput(mm);
 		return ret;
 	}
 
 	case XSC_OP_CLOSE:
-		file = xsc_fget(ctx->files, sqe->fd);
+		/* Fixed slots are released through XSC_IOC_REGISTER_FILES */
+		if (sqe->flags & XSC_F_FIXED_FILE)
+			return -EINVAL;
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 		filp_close(file, ctx->files);
@@ -207,7 +518,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		return 0;
 
 	case XSC_OP_FSYNC:
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 		ret = vfs_fsync(file, 0);
@@ -225,7 +536,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		if (!mm)
 			return -EINVAL;
 
-		kthread_use_mm(mm);
+		xsc_use_mm(mm);
 		tmp = getname(filename);
 		if (IS_ERR(tmp)) {
 			ret = PTR_ERR(tmp);
@@ -253,7 +564,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 			}
 			putname(tmp);
 		}
-		kthread_unuse_mm(mm);
+		xsc_unuse_mm(mm);
 		mmput(mm);
 		return ret;
 	}
@@ -262,7 +573,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		struct stat __user *statbuf = (struct stat __user *)sqe->addr;
 		struct kstat kst;
 
-		file = xsc_fget(ctx->files, sqe->fd);
+		file = xsc_get_file(ctx, sqe);
 		if (!file)
 			return -EBADF;
 
@@ -273,7 +584,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 			mm = get_task_mm(ctx->task);
 			if (mm) {
 				struct stat st;
-				kthread_use_mm(mm);
+				xsc_use_mm(mm);
 				memset(&st, 0, sizeof(st));
 				st.st_dev = kst.dev;
 				st.st_ino = kst.ino;
@@ -290,7 +601,7 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 				st.st_ctime = kst.ctime.tv_sec;
 				if (copy_to_user(statbuf, &st, sizeof(st)))
 					ret = -EFAULT;
-				kthread_unuse_mm(mm);
+				xsc_unuse_mm(mm);
 				mmput(mm);
 			} else {
 				ret = -EINVAL;
@@ -299,6 +610,17 @@ int xsc_dispatch_fs(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cq
 		return ret;
 	}
 
+	case XSC_OP_SPLICE:
+	case XSC_OP_TEE:
+		return xsc_splice(ctx, sqe);
+
+	case XSC_OP_SENDFILE:
+		return xsc_sendfile(ctx, sqe);
+
+	case XSC_OP_COPY_FILE_RANGE:
+	case XSC_OP_CLONE_RANGE:
+		return xsc_copy_range(ctx, sqe);
+
 	default:
 		return -EINVAL;
 	}
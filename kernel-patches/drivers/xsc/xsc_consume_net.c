@@ -7,8 +7,287 @@
 #include <linux/socket.h>
 #include <linux/file.h>
 #include <net/sock.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/uio.h>
+#include <linux/poll.h>
+#include <linux/sched/mm.h>
 #include "xsc_internal.h"
 
+/*
+ * Multishot ops post one CQE per result, flagged XSC_CQE_F_MORE, until an
+ * error ends them; that last CQE has no F_MORE. They hold no worker: the
+ * socket's wakeups retry them without blocking (xsc_poll_arm_op()), and
+ * XSC_OP_ASYNC_CANCEL removes them (-ECANCELED). They never link: the
+ * chain would wait for ever. Nor do they take a peer address: every
+ * result would overwrite the one before while userspace still reads it.
+ */
+static int xsc_multishot_check(const struct xsc_sqe *sqe, u64 addr)
+{
+	if ((sqe->flags & XSC_F_MULTISHOT) &&
+	    ((sqe->flags & XSC_F_LINK) || addr))
+		return -EINVAL;
+	return 0;
+}
+
+static int xsc_multishot_arm(struct xsc_ctx *ctx, struct xsc_sqe *sqe,
+			     int (*issue)(struct xsc_ctx *,
+					  const struct xsc_sqe *,
+					  struct file *, u32 *))
+{
+	struct file *file;
+
+	file = xsc_get_file(ctx, sqe);
+	if (!file)
+		return -EBADF;
+	if (!sock_from_file(file)) {
+		fput(file);
+		return -ENOTSOCK;
+	}
+	return xsc_poll_arm_op(ctx, sqe, file, EPOLLIN, issue);
+}
+
+/*
+ * No multishot: its attempts run from a kworker, whose fd table is not
+ * the owner's, and nothing here can install an fd in the owner's table
+ * from there.
+ */
+static int xsc_accept(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	struct sockaddr __user *addr = (struct sockaddr __user *)sqe->addr;
+	int __user *addrlen = (int __user *)sqe->addr2;
+
+	return __sys_accept4(sqe->fd, addr, addrlen, sqe->accept_flags);
+}
+
+/* One message into a provided buffer, if one is queued */
+static int xsc_recv_issue(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+			  struct file *file, u32 *cflags)
+{
+	struct msghdr msg = {};
+	struct xsc_buf buf;
+	struct iovec iov;
+	int ret;
+
+	if (!xsc_buf_select(ctx, sqe->buf_group, &buf))
+		return -ENOBUFS;
+
+	ret = import_single_range(READ, u64_to_user_ptr(buf.addr), buf.len,
+				  &iov, &msg.msg_iter);
+	if (!ret)
+		ret = sock_recvmsg(sock_from_file(file), &msg,
+				   sqe->msg_flags | MSG_DONTWAIT);
+	if (ret <= 0) {
+		xsc_buf_recycle(ctx, sqe->buf_group, &buf);
+		return ret;
+	}
+	xsc_buf_consumed(ctx, sqe->buf_group);
+	*cflags = XSC_CQE_F_MORE | xsc_buf_cflags(&buf);
+	return ret;
+}
+
+/*
+ * With XSC_F_BUFFER_SELECT the data goes to a buffer from sqe->buf_group
+ * (sqe->addr and sqe->len are unused), named in the CQE. Multishot needs
+ * it: one buffer per message, until the peer closes (res 0), an error,
+ * or the group runs dry (-ENOBUFS). Multishot takes no source address
+ * (sqe->addr2 must be 0).
+ */
+static int xsc_recvfrom(struct xsc_ctx *ctx, struct xsc_sqe *sqe,
+			struct xsc_cqe *cqe)
+{
+	struct sockaddr __user *addr = (struct sockaddr __user *)sqe->addr2;
+	int __user *addrlen = (int __user *)(sqe->addr2 + sizeof(struct sockaddr_storage));
+	struct xsc_buf buf;
+	int ret;
+
+	if (!(sqe->flags & XSC_F_BUFFER_SELECT)) {
+		if (sqe->flags & XSC_F_MULTISHOT)
+			return -EINVAL;
+		return __sys_recvfrom(sqe->fd, (void __user *)sqe->addr, sqe->len,
+				      sqe->msg_flags, addr, addrlen);
+	}
+	ret = xsc_multishot_check(sqe, sqe->addr2);
+	if (ret)
+		return ret;
+	if (sqe->flags & XSC_F_MULTISHOT)
+		return xsc_multishot_arm(ctx, sqe, xsc_recv_issue);
+
+	if (!xsc_buf_select(ctx, sqe->buf_group, &buf))
+		return -ENOBUFS;
+
+	ret = __sys_recvfrom(sqe->fd, u64_to_user_ptr(buf.addr), buf.len,
+			     sqe->msg_flags, addr, addrlen);
+	if (ret <= 0) {
+		xsc_buf_recycle(ctx, sqe->buf_group, &buf);
+		return ret;
+	}
+	xsc_buf_consumed(ctx, sqe->buf_group);
+	cqe->flags = xsc_buf_cflags(&buf);
+	return ret;
+}
+
+/*
+ * XSC_OP_SEND_ZC: the skbs reference the user pages instead of copying
+ * them, so the buffer stays in use after the send returns. The op posts
+ * its result (XSC_CQE_F_MORE), then, once the stack dropped the last skb
+ * holding the pages, a notification CQE (XSC_CQE_F_NOTIF, res 0) with
+ * the same user_data; only then may the buffer be reused. Where the
+ * stack had to copy after all (loopback and veth deliver to a local
+ * socket that way), the notification also carries XSC_CQE_F_COPIED. A
+ * send that fails posts no notification.
+ */
+struct xsc_zc_notif {
+	struct ubuf_info	ubuf;
+	struct xsc_ctx		*ctx;
+	u64			user_data;
+	bool			copied;
+	bool			failed;
+};
+
+/* Any context; the last reference posts the notification */
+static void xsc_zc_callback(struct sk_buff *skb, struct ubuf_info *uarg,
+			    bool zerocopy_success)
+{
+	struct xsc_zc_notif *n = container_of(uarg, struct xsc_zc_notif, ubuf);
+
+	if (!zerocopy_success)
+		WRITE_ONCE(n->copied, true);
+	if (!refcount_dec_and_test(&uarg->refcnt))
+		return;
+
+	if (!n->failed)
+		xsc_post_cqe(n->ctx, XSC_OP_SEND_ZC, n->user_data, 0,
+			     XSC_CQE_F_NOTIF |
+			     (READ_ONCE(n->copied) ? XSC_CQE_F_COPIED : 0));
+	xsc_ctx_put(n->ctx);
+	kfree(n);
+}
+
+static int xsc_send_zc(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	struct sockaddr_storage address;
+	struct msghdr msg = {};
+	struct xsc_zc_notif *n;
+	struct socket *sock;
+	struct file *file;
+	struct iovec iov;
+	int ret;
+
+	file = xsc_get_file(ctx, sqe);
+	if (!file)
+		return -EBADF;
+	sock = sock_from_file(file);
+	if (!sock) {
+		ret = -ENOTSOCK;
+		goto out;
+	}
+	/* Only protocols that honour msg_ubuf (TCP, UDP) */
+	if (!test_bit(SOCK_SUPPORT_ZC, &sock->flags)) {
+		ret = -EOPNOTSUPP;
+		goto out;
+	}
+
+	ret = import_single_range(WRITE, u64_to_user_ptr(sqe->addr), sqe->len,
+				  &iov, &msg.msg_iter);
+	if (ret)
+		goto out;
+	if (sqe->addr2) {
+		ret = move_addr_to_kernel(u64_to_user_ptr(sqe->addr2), sqe->off,
+					  &address);
+		if (ret)
+			goto out;
+		msg.msg_name = &address;
+		msg.msg_namelen = sqe->off;
+	}
+
+	n = kzalloc(sizeof(*n), GFP_KERNEL);
+	if (!n) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	n->ubuf.callback = xsc_zc_callback;
+	n->ubuf.flags = SKBFL_ZEROCOPY_FRAG | SKBFL_DONT_ORPHAN;
+	refcount_set(&n->ubuf.refcnt, 1);
+	n->ctx = ctx;
+	n->user_data = sqe->user_data;
+	xsc_ctx_get(ctx);
+
+	msg.msg_flags = sqe->msg_flags | MSG_ZEROCOPY;
+	if (sock->file->f_flags & O_NONBLOCK)
+		msg.msg_flags |= MSG_DONTWAIT;
+	msg.msg_ubuf = &n->ubuf;
+	ret = sock_sendmsg(sock, &msg);
+
+	/* The result goes first, so the notification always follows it */
+	if (ret >= 0)
+		xsc_post_cqe(ctx, XSC_OP_SEND_ZC, sqe->user_data, ret,
+			     XSC_CQE_F_MORE);
+	else
+		n->failed = true;
+	xsc_zc_callback(NULL, &n->ubuf, true);
+out:
+	fput(file);
+	return ret >= 0 ? -EIOCBQUEUED : ret;
+}
+
+/*
+ * XSC_OP_SENDMSG and XSC_OP_RECVMSG on the socket xsc_get_file()
+ * resolves, so fixed files and the restriction slots apply. Control
+ * messages go through as with sendmsg(2) and recvmsg(2): UDP_SEGMENT
+ * (GSO) on send and UDP_GRO on receive work unchanged. Native layout:
+ * workers are not compat.
+ */
+static int xsc_msg(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	struct user_msghdr __user *umsg = u64_to_user_ptr(sqe->addr);
+	struct iovec iovstack[UIO_FASTIOV], *iov = iovstack;
+	unsigned int flags = sqe->msg_flags;
+	struct sockaddr __user *uaddr;
+	struct msghdr msg = {};
+	struct mm_struct *mm;
+	struct socket *sock;
+	struct file *file;
+	int ret;
+
+	if (flags & MSG_CMSG_COMPAT)
+		return -EINVAL;
+
+	file = xsc_get_file(ctx, sqe);
+	if (!file)
+		return -EBADF;
+	sock = sock_from_file(file);
+	if (!sock) {
+		ret = -ENOTSOCK;
+		goto out;
+	}
+	mm = get_task_mm(ctx->task);
+	if (!mm) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	xsc_use_mm(mm);
+	if (sqe->opcode == XSC_OP_SENDMSG) {
+		ret = sendmsg_copy_msghdr(&msg, umsg, flags, &iov);
+		if (!ret) {
+			ret = __sys_sendmsg_sock(sock, &msg, flags);
+			kfree(iov);
+		}
+	} else {
+		ret = recvmsg_copy_msghdr(&msg, umsg, flags, &uaddr, &iov);
+		if (!ret) {
+			ret = __sys_recvmsg_sock(sock, &msg, umsg, uaddr, flags);
+			kfree(iov);
+		}
+	}
+	xsc_unuse_mm(mm);
+	mmput(mm);
+out:
+	fput(file);
+	return ret;
+}
+
 int xsc_dispatch_net(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cqe)
 {
 	switch (sqe->opcode) {
@@ -23,11 +302,8 @@ int xsc_dispatch_net(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *c
 	case XSC_OP_LISTEN:
 		return __sys_listen(sqe->fd, sqe->len);
 
-	case XSC_OP_ACCEPT: {
-		struct sockaddr __user *addr = (struct sockaddr __user *)sqe->addr;
-		int __user *addrlen = (int __user *)sqe->addr2;
-		return __sys_accept4(sqe->fd, addr, addrlen, sqe->accept_flags);
-	}
+	case XSC_OP_ACCEPT:
+		return xsc_accept(ctx, sqe);
 
 	case XSC_OP_CONNECT: {
 		struct sockaddr __user *addr = (struct sockaddr __user *)sqe->addr;
@@ -40,11 +316,27 @@ int xsc_dispatch_net(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *c
 		return __sys_sendto(sqe->fd, buf, sqe->len, sqe->msg_flags, addr, sqe->off);
 	}
 
-	case XSC_OP_RECVFROM: {
-		void __user *buf = (void __user *)sqe->addr;
-		struct sockaddr __user *addr = (struct sockaddr __user *)sqe->addr2;
-		int __user *addrlen = (int __user *)(sqe->addr2 + sizeof(struct sockaddr_storage));
-		return __sys_recvfrom(sqe->fd, buf, sqe->len, sqe->msg_flags, addr, addrlen);
+	case XSC_OP_RECVFROM:
+		return xsc_recvfrom(ctx, sqe, cqe);
+
+	case XSC_OP_SEND_ZC:
+		return xsc_send_zc(ctx, sqe);
+
+	case XSC_OP_SENDMSG:
+	case XSC_OP_RECVMSG:
+		return xsc_msg(ctx, sqe);
+
+	/* Plain fds only (XSC_F_FIXED_FILE fails), as sendmmsg(2) etc. */
+	case XSC_OP_SENDMMSG: {
+		struct mmsghdr __user *mmsg = u64_to_user_ptr(sqe->addr);
+		return __sys_sendmmsg(sqe->fd, mmsg, sqe->len, sqe->msg_flags, true);
+	}
+
+	case XSC_OP_RECVMMSG: {
+		struct mmsghdr __user *mmsg = u64_to_user_ptr(sqe->addr);
+		struct __kernel_timespec __user *timeout = u64_to_user_ptr(sqe->addr2);
+		return __sys_recvmmsg(sqe->fd, mmsg, sqe->len, sqe->msg_flags,
+				      timeout, NULL);
 	}
 
 	default:
@@ -24,9 +24,11 @@
 #include <linux/anon_inodes.h>
 #include <linux/file.h>
 #include <linux/vmalloc.h>
+#include <linux/seq_file.h>
 
 #include "xsc_uapi.h"
 #include "xsc_internal.h"
+#include "xsc_trace.h"
 #include "../include/xsc_wait.h"
 #include "../include/xsc_mode.h"
 
@@ -174,15 +176,17 @@ static int xsc_setup_rings(struct xsc_ctx *ctx, struct xsc_params *p)
 	ring->cq_overflow = ring->cq_ring + sizeof(u32) * 4;
 	*ring->cq_mask = p->cq_entries - 1;
 
-	/* Setup worker */
-	ctx->wq = alloc_workqueue("xsc_wq", WQ_UNBOUND | WQ_HIGHPRI, 0);
-	if (!ctx->wq) {
-		ret = -ENOMEM;
+	/* Setup SQ feeder and domain workers */
+	ret = xsc_sched_setup(ctx, p->max_workers);
+	if (ret)
 		goto err_cqe_map;
-	}
 
 	INIT_WORK(&ctx->sq_work, xsc_sq_worker);
 
+	/* v8-D §10: Persistent, topology-aware worker placement */
+	xsc_place_setup(ctx, p->placement);
+	xsc_exec_setup(ctx, p->placement != XSC_PLACE_DEFAULT);
+
 	return 0;
 
 err_cqe_map:
@@ -230,8 +234,51 @@ static void xsc_free_rings(struct xsc_ctx *ctx)
 	xsc_free_ring_pages(ring->sq_pages, ring->sq_npages);
 }
 
+/*
+ * Ops that resolve sqe->fd through xsc_get_file(), and so honour
+ * XSC_F_FIXED_FILE. The others take sqe->fd as a plain fd number: with
+ * the flag they would reach an fd outside the slots restrictions vet.
+ */
+static bool xsc_op_fixed_file(const struct xsc_sqe *sqe)
+{
+	switch (sqe->opcode) {
+	case XSC_OP_READ:
+	case XSC_OP_WRITE:
+	case XSC_OP_PREAD:
+	case XSC_OP_PWRITE:
+	case XSC_OP_READV:
+	case XSC_OP_WRITEV:
+	case XSC_OP_FSYNC:
+	case XSC_OP_FSTAT:
+	case XSC_OP_SPLICE:
+	case XSC_OP_TEE:
+	case XSC_OP_SENDFILE:
+	case XSC_OP_COPY_FILE_RANGE:
+	case XSC_OP_CLONE_RANGE:
+	case XSC_OP_POLL_ADD:
+	case XSC_OP_ASYNC_CANCEL:
+	case XSC_OP_SEND_ZC:
+	case XSC_OP_SENDMSG:
+	case XSC_OP_RECVMSG:
+		return true;
+	case XSC_OP_RECVFROM:
+		return sqe->flags & XSC_F_MULTISHOT;
+	default:
+		return false;
+	}
+}
+
 static int xsc_dispatch_op(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cqe)
 {
+	if (sqe->flags & XSC_F_FIXED_FILE && !xsc_op_fixed_file(sqe))
+		return -EINVAL;
+	/* Only the ops that implement them */
+	if (sqe->flags & XSC_F_MULTISHOT && sqe->opcode != XSC_OP_RECVFROM &&
+	    sqe->opcode != XSC_OP_TIMEOUT && sqe->opcode != XSC_OP_POLL_ADD)
+		return -EINVAL;
+	if (sqe->flags & XSC_F_BUFFER_SELECT && sqe->opcode != XSC_OP_RECVFROM)
+		return -EINVAL;
+
 	switch (sqe->opcode) {
 	case XSC_OP_READ:
 	case XSC_OP_WRITE:
@@ -245,9 +292,19 @@ static int xsc_dispatch_op(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_
 	case XSC_OP_STAT:
 	case XSC_OP_FSTAT:
 	case XSC_OP_LSTAT:
+	case XSC_OP_SPLICE:
+	case XSC_OP_TEE:
+	case XSC_OP_SENDFILE:
+	case XSC_OP_COPY_FILE_RANGE:
+	case XSC_OP_CLONE_RANGE:
 		return xsc_dispatch_fs(ctx, sqe, cqe);
 
 	case XSC_OP_SENDTO:
+	case XSC_OP_SEND_ZC:
+	case XSC_OP_SENDMSG:
+	case XSC_OP_RECVMSG:
+	case XSC_OP_SENDMMSG:
+	case XSC_OP_RECVMMSG:
 	case XSC_OP_RECVFROM:
 	case XSC_OP_ACCEPT:
 	case XSC_OP_CONNECT:
@@ -274,35 +331,135 @@ static int xsc_dispatch_op(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_
 	case XSC_OP_EXECVEAT:
 		return xsc_dispatch_exec(ctx, sqe, cqe);
 
+	case XSC_OP_ASYNC_CANCEL:
+		return xsc_sched_cancel(ctx, sqe);
+
+	case XSC_OP_TIMEOUT:
+		return xsc_timeout_start(ctx, sqe);
+
+	case XSC_OP_POLL_ADD:
+		return xsc_poll_add(ctx, sqe);
+
+	case XSC_OP_POLL_REMOVE:
+		return xsc_poll_remove(ctx, sqe);
+
 	default:
 		return -EINVAL;
 	}
 }
 
-static void xsc_complete_cqe(struct xsc_ctx *ctx, u64 user_data, s32 res)
+/* CQ full: the CQE is dropped and counted in the shared overflow word */
+static void xsc_cq_overflow(struct xsc_ctx *ctx, u8 opcode)
+{
+	u32 *ov = ctx->ring.cq_overflow;
+	u32 old = READ_ONCE(*ov);
+
+	while (!try_cmpxchg(ov, &old, old + 1))
+		;
+	this_cpu_inc(ctx->metrics->overflows);
+	trace_xsc_drop(ctx, opcode, -EOVERFLOW);
+}
+
+/*
+ * xsc_post_cqe - Post a CQE, lock-free
+ *
+ * Any number of workers (and timer callbacks) may complete on one ring
+ * at once. A completer claims a slot by advancing cq_claim, which only
+ * succeeds while the slot is free for userspace's cq_head, fills it,
+ * then waits for every earlier claim to be published and publishes its
+ * own by advancing cq_committed and the shared cq_tail. Userspace thus
+ * never sees a tail past an unfilled CQE.
+ *
+ * The claim-to-publish window is a handful of stores, run with IRQs off
+ * so a completion from interrupt context can never spin on a claim that
+ * the task it interrupted holds. cq_tail in the shared page is written
+ * but never read back, so userspace cannot stall the publish loop.
+ */
+void xsc_post_cqe(struct xsc_ctx *ctx, u8 opcode, u64 user_data, s32 res,
+		  u32 cflags)
 {
 	struct xsc_ring *ring = &ctx->ring;
 	struct xsc_cqe *cqe;
-	u32 tail;
+	unsigned long flags;
+	u32 slot;
+
+	local_irq_save(flags);
+
+	slot = READ_ONCE(ctx->cq_claim);
+	do {
+		/* Acquire: userspace is done reading the slot it freed */
+		if (slot - smp_load_acquire(ring->cq_head) >= ring->cq_entries) {
+			local_irq_restore(flags);
+			xsc_cq_overflow(ctx, opcode);
+			return;
+		}
+	} while (!try_cmpxchg(&ctx->cq_claim, &slot, slot + 1));
 
-	spin_lock(&ctx->lock);
+	cqe = ring->cqes + (slot & *ring->cq_mask) * sizeof(struct xsc_cqe);
+	WRITE_ONCE(cqe->user_data, user_data);
+	WRITE_ONCE(cqe->res, res);
+	WRITE_ONCE(cqe->flags, cflags);
+
+	/* Publish in claim order */
+	while (smp_load_acquire(&ctx->cq_committed) != slot)
+		cpu_relax();
+	smp_store_release(ring->cq_tail, slot + 1);
+	smp_store_release(&ctx->cq_committed, slot + 1);
+
+	local_irq_restore(flags);
+
+	this_cpu_inc(ctx->metrics->completed);
+	trace_xsc_complete(ctx, opcode, user_data, res);
+
+	if (wq_has_sleeper(&ctx->cq_wait))
+		wake_up_interruptible(&ctx->cq_wait);
+}
+
+/*
+ * xsc_trace_sqes_seen - Emit xsc_submit for newly observed SQEs
+ *
+ * Only called when the tracepoint is enabled. The SQEs are still owned
+ * by the kernel here, so reading them is stable.
+ */
+static void xsc_trace_sqes_seen(struct xsc_ctx *ctx, u32 head, u32 tail)
+{
+	struct xsc_ring *ring = &ctx->ring;
+	struct xsc_sqe *sqe;
 
-	tail = *ring->cq_tail;
-	cqe = ring->cqes + (tail & *ring->cq_mask) * sizeof(struct xsc_cqe);
+	if (tail - head > ring->sq_entries)
+		head = tail - ring->sq_entries;
 
-	cqe->user_data = user_data;
-	cqe->res = res;
-	cqe->flags = 0;
+	for (; head != tail; head++) {
+		sqe = ring->sqes + (head & *ring->sq_mask) * sizeof(struct xsc_sqe);
+		trace_xsc_submit(ctx, sqe->opcode, sqe->user_data);
+	}
+}
 
-	/* Memory barrier before updating tail */
-	smp_wmb();
-	WRITE_ONCE(*ring->cq_tail, tail + 1);
+/*
+ * xsc_trace_cqes_reaped - Emit xsc_reap for CQEs userspace consumed
+ *
+ * Userspace advances cq_head without telling us, so reaping is noticed
+ * lazily (worker activation, poll). The CQE slot still holds the entry
+ * unless the ring wrapped since, which is good enough for tracing.
+ */
+static void xsc_trace_cqes_reaped(struct xsc_ctx *ctx)
+{
+	struct xsc_ring *ring = &ctx->ring;
+	struct xsc_cqe *cqe;
+	u32 old, head;
 
-	// trace_xsc_complete(ctx, user_data, res);
+	old = READ_ONCE(ctx->cq_reaped);
+	head = READ_ONCE(*ring->cq_head);
+	if (old == head || cmpxchg(&ctx->cq_reaped, old, head) != old)
+		return;
 
-	spin_unlock(&ctx->lock);
+	if (head - old > ring->cq_entries)
+		old = head - ring->cq_entries;
 
-	wake_up_interruptible(&ctx->cq_wait);
+	for (; old != head; old++) {
+		cqe = ring->cqes + (old & *ring->cq_mask) * sizeof(struct xsc_cqe);
+		trace_xsc_reap(ctx, READ_ONCE(cqe->user_data), READ_ONCE(cqe->res));
+	}
 }
 
 struct xsc_dispatch_closure {
@@ -319,148 +476,331 @@ static void xsc_dispatch_with_ctx(void *data)
 					      closure->cqe);
 }
 
-static void xsc_sq_worker(struct work_struct *work)
+/*
+ * xsc_issue_req - Execute one request and post its CQE
+ *
+ * Runs on a domain worker (xsc_sched.c), several at once for the same
+ * ring, or in the submitter for inline rings. Returns the op's result
+ * so LINK chains can stop early.
+ */
+int xsc_issue_req(struct xsc_ctx *ctx, struct xsc_req *req)
 {
-	struct xsc_ctx *ctx = container_of(work, struct xsc_ctx, sq_work);
-	struct xsc_ring *ring = &ctx->ring;
-	struct xsc_sqe *sqe;
-	struct xsc_cqe cqe;
+	struct xsc_sqe *sqe = &req->sqe;
+	struct xsc_cqe cqe = {};
 	struct xsc_task_cred tc;
 	struct xsc_tp_enter tpe;
 	struct xsc_tp_exit tpx;
-	u32 head, tail, cq_idx;
+	u64 args[6];
+	u64 deq_ns, done_ns;
+	unsigned long nvcsw, nivcsw;
+	int audit;
 	int ret;
 
+	deq_ns = ktime_get_ns();
+	done_ns = deq_ns;
+
+	trace_xsc_dequeue(ctx, sqe->opcode, sqe->user_data,
+			  deq_ns - req->seen_ns);
+
 	/*
-	 * v8-D §10: Set SMT affinity to avoid running on same sibling
-	 * as USER thread. Reduces microarchitectural side-channels.
+	 * Registered ring restrictions: plain bit tests, done before
+	 * anything else so a locked-down ring never snapshots creds
+	 * or runs filters for SQEs it is not allowed to issue.
 	 */
-	xsc_worker_set_affinity(ctx, current);
+	ret = xsc_check_restrictions(ctx, sqe);
+	if (ret) {
+		xsc_complete_cqe(ctx, sqe->opcode, sqe->user_data, ret);
+		goto consumed;
+	}
 
-	while (1) {
-		head = READ_ONCE(*ring->sq_head);
-		tail = READ_ONCE(*ring->sq_tail);
+	/* Cancelled while it waited behind earlier members of its chain */
+	if (READ_ONCE(req->cancelled)) {
+		ret = -ECANCELED;
+		xsc_complete_cqe(ctx, sqe->opcode, sqe->user_data, ret);
+		goto consumed;
+	}
 
-		if (head == tail)
-			break;
+	/* Past its deadline by the time a worker got to it: do not run */
+	if ((sqe->flags & XSC_F_DEADLINE) && deq_ns > sqe->deadline_ns) {
+		ret = -ETIME;
+		xsc_complete_cqe(ctx, sqe->opcode, sqe->user_data, ret);
+		goto consumed;
+	}
 
-		sqe = ring->sqes + (head & *ring->sq_mask) * sizeof(struct xsc_sqe);
+	/*
+	 * v8-D §2.3: Snapshot origin task credentials at SQE dequeue.
+	 * This captures PID, UID, GID, cgroup, and rlimits for attribution.
+	 */
+	xsc_task_cred_snapshot(&tc, ctx->task);
 
-		/*
-		 * v8-D §2.3: Snapshot origin task credentials at SQE dequeue.
-		 * This captures PID, UID, GID, cgroup, and rlimits for attribution.
-		 */
-		xsc_task_cred_snapshot(&tc, ctx->task);
+	/* The ioprio was used for dispatch order; it must also be allowed */
+	ret = xsc_check_ioprio(&tc, sqe->ioprio);
+	if (ret)
+		goto complete;
 
-		/*
-		 * v8-D §5.3: Seccomp check at consume (before execution).
-		 * Semantic syscall number and canonicalized args.
-		 */
-		ret = xsc_seccomp_check(&tc, sqe->opcode, (u64 *)&sqe->arg1);
-		if (ret) {
-			/* Seccomp blocked operation */
-			cqe.user_data = sqe->user_data;
-			cqe.res = ret;
-			cqe.flags = 0;
-			goto complete;
-		}
+	/*
+	 * v8-D §5.3: Seccomp check at consume (before execution).
+	 * Semantic syscall number and canonicalized args.
+	 */
+	xsc_sqe_args(sqe, args);
+	ret = xsc_seccomp_check(&tc, sqe->opcode, args);
+	if (ret) {
+		/* Seccomp blocked operation */
+		goto complete;
+	}
 
-		/*
-		 * v8-D §5.2: Emit sys_enter tracepoint for observability.
-		 * Compatible with strace, BPF, perf.
-		 */
+	/*
+	 * v8-D §5.2: Emit sys_enter tracepoint for observability.
+	 * Compatible with strace, BPF, perf. The record is only
+	 * built and timestamped when someone is listening.
+	 */
+	if (trace_xsc_sys_enter_enabled()) {
 		tpe.pid = tc.pid;
 		tpe.tgid = tc.tgid;
 		tpe.cgroup_id = tc.cgroup_id;
 		tpe.nr = sqe->opcode;  /* Semantic syscall number */
-		tpe.args[0] = sqe->arg1;
-		tpe.args[1] = sqe->arg2;
-		tpe.args[2] = sqe->arg3;
-		tpe.args[3] = sqe->arg4;
-		tpe.args[4] = sqe->arg5;
-		tpe.args[5] = sqe->arg6;
+		memcpy(tpe.args, args, sizeof(tpe.args));
 		tpe.ts_nsec = ktime_get_ns();
 		xsc_trace_sys_enter(&tpe);
+	}
 
-		/*
-		 * v8-D §5.4: Audit log submission.
-		 */
-		xsc_audit_submit(&tc, sqe->opcode, (u64 *)&sqe->arg1);
-
-		/*
-		 * v8-D §8.4: Check for pending signals before dispatch.
-		 * Return -EINTR if fatal signal pending.
-		 */
-		ret = xsc_check_signals(ctx);
-		if (ret) {
-			cqe.user_data = sqe->user_data;
-			cqe.res = ret;
-			cqe.flags = 0;
-			goto complete;
-		}
+	/*
+	 * v8-D §5.4: Audit log submission.
+	 */
+	audit = xsc_audit_enabled() ? xsc_audit_classify(ctx, sqe) :
+				      XSC_AUDIT_SKIP;
+	if (audit == XSC_AUDIT_RECORD)
+		xsc_audit_submit(&tc, sqe->opcode, args);
 
-		/*
-		 * Dispatch to handler (fs, net, timer, sync, exec).
-		 * Handler runs with origin task attribution via tc.
-		 */
-		struct xsc_dispatch_closure closure = {
-			.ctx = ctx,
-			.sqe = sqe,
-			.cqe = &cqe,
-			.ret = 0,
-		};
+	/*
+	 * v8-D §8.4: Check for pending signals before dispatch.
+	 * Return -EINTR if fatal signal pending.
+	 */
+	ret = xsc_check_signals(ctx);
+	if (ret)
+		goto complete;
 
-		xsc_run_with_attribution(ctx, &tc, xsc_dispatch_with_ctx, &closure);
-		ret = closure.ret;
+	/*
+	 * Dispatch to handler (fs, net, timer, sync, exec).
+	 * Handler runs with origin task attribution via tc.
+	 */
+	struct xsc_dispatch_closure closure = {
+		.ctx = ctx,
+		.sqe = sqe,
+		.cqe = &cqe,
+		.ret = 0,
+	};
+
+	trace_xsc_dispatch(ctx, sqe->opcode, sqe->user_data,
+			   raw_smp_processor_id());
+	nvcsw = current->nvcsw;
+	nivcsw = current->nivcsw;
+	xsc_run_with_attribution(ctx, &tc, xsc_dispatch_with_ctx, &closure);
+	ret = closure.ret;
+
+	/* Interrupted by XSC_OP_ASYNC_CANCEL (xsc_sched_do_cancel()) */
+	if (READ_ONCE(req->cancelled) &&
+	    (ret == -EINTR || ret == -ERESTARTSYS || ret == -ERESTARTNOINTR ||
+	     ret == -ERESTARTNOHAND || ret == -ERESTART_RESTARTBLOCK))
+		ret = -ECANCELED;
+
+	/* Attribute tail latency to blocking inside the handler */
+	if (current->nvcsw != nvcsw || current->nivcsw != nivcsw)
+		trace_xsc_block(ctx, sqe->opcode, sqe->user_data,
+				current->nvcsw - nvcsw,
+				current->nivcsw - nivcsw);
+
+	done_ns = ktime_get_ns();
+	if (req->inline_exec) {
+		this_cpu_inc(ctx->metrics->inline_ops);
+	} else {
+		this_cpu_inc(ctx->metrics->worker_ops);
+		atomic64_add(done_ns - deq_ns, &ctx->busy_ns);
+		xsc_core_account(done_ns - deq_ns);
+	}
+	xsc_metrics_op(ctx, sqe->opcode, deq_ns - req->seen_ns,
+		       done_ns - deq_ns);
 
-		/*
-		 * v8-D §5.2: Emit sys_exit tracepoint.
-		 */
+	/*
+	 * v8-D §5.2: Emit sys_exit tracepoint.
+	 */
+	if (trace_xsc_sys_exit_enabled()) {
 		tpx.pid = tc.pid;
 		tpx.tgid = tc.tgid;
 		tpx.ret = ret;
 		tpx.ts_nsec = ktime_get_ns();
 		xsc_trace_sys_exit(&tpx);
+	}
 
-		/*
-		 * v8-D §5.4: Audit log result.
-		 */
+	/*
+	 * v8-D §5.4: Audit log result.
+	 */
+	if (audit == XSC_AUDIT_RECORD)
 		xsc_audit_result(&tc, ret);
-
-		/* Prepare CQE */
-		cqe.user_data = sqe->user_data;
-		cqe.res = ret;
-		cqe.flags = 0;
+	else if (audit == XSC_AUDIT_SUMMARY)
+		xsc_audit_account(ctx, &tc, sqe, ret);
 
 complete:
-		/*
-		 * v8-D §2.5: Write CQE with batched SMAP toggles.
-		 * Uses optimized xsc_cqe_write() instead of direct copy.
-		 */
-		cq_idx = READ_ONCE(*ring->cq_tail);
-		xsc_cqe_write(ctx, &cqe, cq_idx);
+	/* Timer, poll and zero-copy ops post their CQEs themselves */
+	if (ret == -EIOCBQUEUED)
+		ret = 0;
+	else
+		xsc_post_cqe(ctx, sqe->opcode, sqe->user_data, ret, cqe.flags);
 
-		/* Update CQ tail */
-		smp_wmb();
-		WRITE_ONCE(*ring->cq_tail, cq_idx + 1);
+	/*
+	 * v8-D §2.3: Release credential snapshot.
+	 */
+	xsc_task_cred_release(&tc);
 
-		/* Wake waiting threads */
-		wake_up_interruptible(&ctx->cq_wait);
+consumed:
+	xsc_frec_record(ctx, sqe, ret, deq_ns, done_ns);
+	return ret;
+}
 
-		/*
-		 * v8-D §2.3: Release credential snapshot.
-		 */
-		xsc_task_cred_release(&tc);
+/*
+ * xsc_sq_worker - SQ feeder
+ *
+ * Copies newly submitted SQEs into requests and hands them to the
+ * scheduler, releasing each SQ slot as soon as it is copied. Execution
+ * happens on the ring's domain workers.
+ */
+static void xsc_sq_worker(struct work_struct *work)
+{
+	struct xsc_ctx *ctx = container_of(work, struct xsc_ctx, sq_work);
+	struct xsc_ring *ring = &ctx->ring;
+	struct xsc_sqe *sqe;
+	u32 head, tail;
+	u32 quantum = xsc_fair_quantum(ctx);
+	u64 now, seen_ns;
+	int ret;
+
+	/* SQEs already queued were seen when userspace kicked the ring */
+	now = ktime_get_ns();
+	seen_ns = min(READ_ONCE(ctx->kick_ns) ?: now, now);
+	this_cpu_inc(ctx->metrics->wakeups);
+	this_cpu_inc(ctx->metrics->wakeup_lat[xsc_hist_bucket(now - seen_ns)]);
+
+	if (trace_xsc_reap_enabled())
+		xsc_trace_cqes_reaped(ctx);
+
+	mutex_lock(&ctx->sq_lock);
+	while (1) {
+		head = READ_ONCE(*ring->sq_head);
+		tail = smp_load_acquire(ring->sq_tail);
+		if (head == tail)
+			break;
+
+		/* v8-D §11: a flooded SQ yields to other rings' work */
+		if (!quantum) {
+			queue_work(ctx->wq, &ctx->sq_work);
+			break;
+		}
+		tail = head + min(tail - head, quantum);
+		quantum -= tail - head;
+
+		/* Each scan is one batch-size sample and one "seen" time */
+		xsc_metrics_batch(ctx, tail - head);
+		if (trace_xsc_submit_enabled())
+			xsc_trace_sqes_seen(ctx, head, tail);
+
+		for (; head != tail; head++) {
+			sqe = ring->sqes + (head & *ring->sq_mask) *
+					   sizeof(struct xsc_sqe);
+			ret = xsc_sched_submit(ctx, sqe, seen_ns);
+			if (ret)
+				xsc_complete_cqe(ctx, sqe->opcode,
+						 sqe->user_data, ret);
+
+			/* The SQE is copied; userspace may reuse the slot */
+			smp_store_release(ring->sq_head, head + 1);
+			ctx->sq_consumed++;
+		}
 
-		/* Update SQ head */
-		smp_mb();
-		WRITE_ONCE(*ring->sq_head, head + 1);
+		seen_ns = ktime_get_ns();
 	}
+	mutex_unlock(&ctx->sq_lock);
+}
+
+/*
+ * xsc_submit_inline - Serve the SQ on the submitting CPU
+ *
+ * For rings in XSC_EXEC_INLINE: no worker wakeup, no cross-core hop.
+ * Only taken when the ring is idle (nothing routed to workers, no open
+ * chain) so it cannot overtake earlier async work, and only from the
+ * owner's thread group, whose mm and files the handlers use. Like a
+ * plain syscall, the submitter blocks if an op does; the controller
+ * moves rings off inline once their rate makes that matter. Returns
+ * false to fall back to the workers.
+ */
+static bool xsc_submit_inline(struct xsc_ctx *ctx, u64 now)
+{
+	struct xsc_ring *ring = &ctx->ring;
+	struct xsc_req req;
+	struct xsc_sqe *sqe;
+	bool cancel = false;
+	u32 head, tail, i;
+	int ret;
+
+	if (!same_thread_group(current, ctx->task))
+		return false;
+	if (!mutex_trylock(&ctx->sq_lock))
+		return false;
+	if (ctx->link_head || !xsc_sched_idle(ctx))
+		goto async;
+
+	head = READ_ONCE(*ring->sq_head);
+	tail = smp_load_acquire(ring->sq_tail);
+	if (head == tail)
+		goto out;
+	if (tail - head > ring->sq_entries)
+		goto async;
+
+	/* A chain left open at the end of the batch is the feeder's job */
+	sqe = ring->sqes + ((tail - 1) & *ring->sq_mask) * sizeof(struct xsc_sqe);
+	if (READ_ONCE(sqe->flags) & XSC_F_LINK)
+		goto async;
 
 	/*
-	 * v8-D §10: Clear SMT affinity restrictions after processing.
+	 * So are linked timeouts, which need the chain built, and multishot
+	 * ops, which would not give the submitter back
 	 */
-	xsc_worker_clear_affinity(current);
+	for (i = head; i != tail; i++) {
+		sqe = ring->sqes + (i & *ring->sq_mask) * sizeof(struct xsc_sqe);
+		if (READ_ONCE(sqe->opcode) == XSC_OP_LINK_TIMEOUT ||
+		    READ_ONCE(sqe->flags) & XSC_F_MULTISHOT)
+			goto async;
+	}
+
+	xsc_metrics_batch(ctx, tail - head);
+	if (trace_xsc_submit_enabled())
+		xsc_trace_sqes_seen(ctx, head, tail);
+
+	for (; head != tail; head++) {
+		sqe = ring->sqes + (head & *ring->sq_mask) * sizeof(struct xsc_sqe);
+		memcpy(&req.sqe, sqe, sizeof(req.sqe));
+		req.seen_ns = now;
+		req.link = NULL;
+		req.inline_exec = true;
+		req.cancelled = false;
+		smp_store_release(ring->sq_head, head + 1);
+		ctx->sq_consumed++;
+
+		if (cancel) {
+			xsc_complete_cqe(ctx, req.sqe.opcode, req.sqe.user_data,
+					 -ECANCELED);
+			ret = -ECANCELED;
+		} else {
+			ret = xsc_issue_req(ctx, &req);
+		}
+		cancel = (req.sqe.flags & XSC_F_LINK) && ret < 0;
+	}
+out:
+	mutex_unlock(&ctx->sq_lock);
+	return true;
+
+async:
+	mutex_unlock(&ctx->sq_lock);
+	return false;
 }
 
 static long xsc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
@@ -477,6 +817,16 @@ static long xsc_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
 		return xsc_setup_rings(ctx, &params);
 	}
+	case XSC_IOC_REGISTER_FILES:
+		return xsc_register_files(ctx, argp);
+	case XSC_IOC_UNREGISTER_FILES:
+		return xsc_unregister_files(ctx);
+	case XSC_IOC_REGISTER_RESTRICTIONS:
+		return xsc_register_restrictions(ctx, argp);
+	case XSC_IOC_FLIGHT_RECORDER:
+		return xsc_frec_read(ctx, argp);
+	case XSC_IOC_PROVIDE_BUFFERS:
+		return xsc_provide_buffers(ctx, argp);
 	default:
 		return -EINVAL;
 	}
@@ -525,12 +875,36 @@ static __poll_t xsc_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &ctx->cq_wait, wait);
 
+	if (trace_xsc_reap_enabled())
+		xsc_trace_cqes_reaped(ctx);
+
 	if (READ_ONCE(*ring->cq_head) != READ_ONCE(*ring->cq_tail))
 		mask |= EPOLLIN | EPOLLRDNORM;
 
 	return mask;
 }
 
+static void xsc_ctx_free(struct work_struct *work)
+{
+	struct xsc_ctx *ctx = container_of(work, struct xsc_ctx, free_work);
+
+	xsc_free_rings(ctx);
+	xsc_metrics_free(ctx);
+	kfree(ctx);
+}
+
+/*
+ * xsc_ctx_put - Drop a reference to the ring
+ *
+ * Any context: the last put may come from a skb being freed in softirq,
+ * and unmapping the rings sleeps, so the free is always deferred.
+ */
+void xsc_ctx_put(struct xsc_ctx *ctx)
+{
+	if (refcount_dec_and_test(&ctx->refs))
+		queue_work(system_unbound_wq, &ctx->free_work);
+}
+
 static int xsc_open(struct inode *inode, struct file *file)
 {
 	struct xsc_ctx *ctx;
@@ -540,23 +914,53 @@ static int xsc_open(struct inode *inode, struct file *file)
 	if (!ctx)
 		return -ENOMEM;
 
+	ret = xsc_metrics_alloc(ctx);
+	if (ret)
+		goto err_free;
+
+	ret = xsc_frec_alloc(ctx);
+	if (ret)
+		goto err_metrics;
+
 	ret = xsc_enter_mode(current, ctx);
-	if (ret) {
-		kfree(ctx);
-		return ret;
-	}
+	if (ret)
+		goto err_frec;
 
 	spin_lock_init(&ctx->lock);
+	spin_lock_init(&ctx->sched_lock);
+	mutex_init(&ctx->sq_lock);
+	INIT_LIST_HEAD(&ctx->deferred);
+	INIT_LIST_HEAD(&ctx->running);
+	spin_lock_init(&ctx->timeout_lock);
+	INIT_LIST_HEAD(&ctx->timeouts);
+	spin_lock_init(&ctx->poll_lock);
+	INIT_LIST_HEAD(&ctx->polls);
+	mutex_init(&ctx->files_lock);
+	mutex_init(&ctx->buf_lock);
+	xa_init(&ctx->buf_groups);
 	init_waitqueue_head(&ctx->cq_wait);
+	refcount_set(&ctx->refs, 1);
+	INIT_WORK(&ctx->free_work, xsc_ctx_free);
 	ctx->file = file;
 	ctx->task = current;
 	ctx->files = current->files;
 	get_task_struct(ctx->task);
 	ctx->cpu = -1;
+	INIT_LIST_HEAD(&ctx->node);
 
 	file->private_data = ctx;
+	xsc_ctx_register(ctx);
+	xsc_debugfs_ring_add(ctx);
 
 	return 0;
+
+err_frec:
+	xsc_frec_free(ctx);
+err_metrics:
+	xsc_metrics_free(ctx);
+err_free:
+	kfree(ctx);
+	return ret;
 }
 
 static int xsc_release(struct inode *inode, struct file *file)
@@ -564,6 +968,8 @@ static int xsc_release(struct inode *inode, struct file *file)
 	struct xsc_ctx *ctx = file->private_data;
 
 	if (ctx) {
+		xsc_debugfs_ring_remove(ctx);
+		xsc_ctx_unregister(ctx);
 		xsc_exit_mode(ctx->task, ctx);
 		/*
 		 * v8-D §8.4: Cancel pending SQEs on ring close.
@@ -571,16 +977,19 @@ static int xsc_release(struct inode *inode, struct file *file)
 		 */
 		xsc_cancel_pending_sqes(ctx);
 
-		/* Flush workqueue to ensure all workers complete */
-		if (ctx->wq) {
-			flush_workqueue(ctx->wq);
-			destroy_workqueue(ctx->wq);
-		}
+		/* Let queued and running requests complete */
+		xsc_place_release(ctx);
+		xsc_sched_release(ctx);
 
-		xsc_free_rings(ctx);
+		xsc_free_files(ctx);
+		xsc_buf_release(ctx);
+		xsc_free_restrictions(ctx);
+		xsc_audit_ring_release(ctx);
+		xsc_frec_free(ctx);
 		if (ctx->task)
 			put_task_struct(ctx->task);
-		kfree(ctx);
+		/* Rings and metrics go with the last zero-copy notification */
+		xsc_ctx_put(ctx);
 	}
 
 	return 0;
@@ -590,14 +999,29 @@ static ssize_t xsc_write(struct file *file, const char __user *buf,
 			  size_t count, loff_t *ppos)
 {
 	struct xsc_ctx *ctx = file->private_data;
+	u64 now = ktime_get_ns();
+
+	if (!ctx->wq)
+		return count;
 
 	/* Writing any data triggers submission queue processing */
-	if (ctx->wq)
-		queue_work(ctx->wq, &ctx->sq_work);
+	xsc_exec_update(ctx, now);
+	if (READ_ONCE(ctx->exec_mode) == XSC_EXEC_INLINE &&
+	    xsc_submit_inline(ctx, now))
+		return count;
+
+	WRITE_ONCE(ctx->kick_ns, now);
+	xsc_place_note_cpu(ctx, raw_smp_processor_id());
+	queue_work(ctx->wq, &ctx->sq_work);
 
 	return count;
 }
 
+static void xsc_show_fdinfo(struct seq_file *m, struct file *file)
+{
+	xsc_metrics_show(m, file->private_data);
+}
+
 static const struct file_operations xsc_fops = {
 	.owner		= THIS_MODULE,
 	.open		= xsc_open,
@@ -606,6 +1030,7 @@ static const struct file_operations xsc_fops = {
 	.mmap		= xsc_mmap,
 	.poll		= xsc_poll,
 	.write		= xsc_write,
+	.show_fdinfo	= xsc_show_fdinfo,
 };
 
 static int __init xsc_init(void)
@@ -627,6 +1052,10 @@ static int __init xsc_init(void)
 	}
 	xsc_major = ret;
 
+	xsc_sched_init();
+	xsc_cores_init();
+	xsc_audit_init();
+
 	xsc_class = class_create(THIS_MODULE, XSC_DEVICE_NAME);
 	if (IS_ERR(xsc_class)) {
 		unregister_chrdev(xsc_major, XSC_DEVICE_NAME);
@@ -643,6 +1072,8 @@ static int __init xsc_init(void)
 		return PTR_ERR(xsc_device);
 	}
 
+	xsc_debugfs_init();
+
 	pr_info("xsc: initialized successfully\n");
 	return 0;
 }
@@ -653,6 +1084,8 @@ static void __exit xsc_exit(void)
 	class_destroy(xsc_class);
 	unregister_chrdev(xsc_major, XSC_DEVICE_NAME);
 
+	xsc_debugfs_exit();
+
 	/* Cleanup wait mechanisms */
 	xsc_wait_cleanup();
 
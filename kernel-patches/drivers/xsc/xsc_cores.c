@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC dedicated syscall cores
+ * Copyright (C) 2025
+ *
+ * FlexSC-style core specialization: xsc.syscall_cores=<cpulist> (boot)
+ * or /sys/module/xsc/parameters/syscall_cores (runtime) confines every
+ * ring's workers to those CPUs, on top of the ring's placement policy.
+ * Application cores are meant to run nohz_full and only submit through
+ * rings; setting the mask warns when that does not hold. Writing "none"
+ * (or a smaller list) hands cores back; live rings are re-placed at once.
+ *
+ * Per-CPU worker load is in /sys/kernel/debug/xsc/core_load.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cpumask.h>
+#include <linux/mutex.h>
+#include <linux/tick.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "xsc_internal.h"
+
+DEFINE_PER_CPU(struct xsc_core_stat, xsc_core_stat);
+
+/* Empty: no dedicated cores. Both masks are under xsc_cores_lock. */
+static struct cpumask xsc_syscall_cores;
+static struct cpumask xsc_cores_new;
+static DEFINE_MUTEX(xsc_cores_lock);
+static bool xsc_cores_ready;
+
+static void xsc_cores_check(void)
+{
+	unsigned int busy = 0;
+	int cpu;
+
+	if (cpumask_empty(&xsc_syscall_cores))
+		return;
+
+	for_each_cpu(cpu, &xsc_syscall_cores) {
+		if (!cpu_online(cpu))
+			pr_warn("xsc: syscall core %d is offline\n", cpu);
+		else if (tick_nohz_full_cpu(cpu))
+			pr_warn("xsc: syscall core %d is nohz_full; workers will keep its tick running\n",
+				cpu);
+	}
+
+	if (!tick_nohz_full_enabled()) {
+		pr_warn("xsc: syscall_cores set without nohz_full=; application cores still take ticks\n");
+		return;
+	}
+
+	for_each_online_cpu(cpu) {
+		if (!cpumask_test_cpu(cpu, &xsc_syscall_cores) &&
+		    !tick_nohz_full_cpu(cpu))
+			busy++;
+	}
+	if (busy)
+		pr_warn("xsc: %u application CPUs outside syscall_cores are not nohz_full\n",
+			busy);
+}
+
+static void xsc_cores_replace(struct xsc_ctx *ctx, void *arg)
+{
+	xsc_place_reapply(ctx);
+}
+
+static int xsc_cores_set(const char *val, const struct kernel_param *kp)
+{
+	bool ready = false;
+	int ret = 0;
+
+	/* May run at boot before the allocators are up: no allocation */
+	mutex_lock(&xsc_cores_lock);
+	if (sysfs_streq(val, "") || sysfs_streq(val, "none")) {
+		cpumask_clear(&xsc_cores_new);
+	} else {
+		ret = cpulist_parse(val, &xsc_cores_new);
+		if (!ret && xsc_cores_ready &&
+		    !cpumask_intersects(&xsc_cores_new, cpu_online_mask))
+			ret = -EINVAL;
+	}
+	if (!ret) {
+		cpumask_copy(&xsc_syscall_cores, &xsc_cores_new);
+		ready = xsc_cores_ready;
+		if (ready)
+			xsc_cores_check();
+	}
+	mutex_unlock(&xsc_cores_lock);
+
+	if (!ret && ready)
+		xsc_ctx_for_each(xsc_cores_replace, NULL);
+	return ret;
+}
+
+static int xsc_cores_get(char *buf, const struct kernel_param *kp)
+{
+	int len;
+
+	mutex_lock(&xsc_cores_lock);
+	if (cpumask_empty(&xsc_syscall_cores))
+		len = sprintf(buf, "none\n");
+	else
+		len = sprintf(buf, "%*pbl\n",
+			      cpumask_pr_args(&xsc_syscall_cores));
+	mutex_unlock(&xsc_cores_lock);
+	return len;
+}
+
+static const struct kernel_param_ops xsc_cores_ops = {
+	.set	= xsc_cores_set,
+	.get	= xsc_cores_get,
+};
+module_param_cb(syscall_cores, &xsc_cores_ops, NULL, 0644);
+MODULE_PARM_DESC(syscall_cores,
+		 "CPUs dedicated to running XSC workers (cpulist, or none)");
+
+/*
+ * xsc_cores_restrict - Confine a placement mask to the syscall cores
+ *
+ * If the ring's policy and the dedicated cores do not overlap, the
+ * dedicated cores win: keeping application cores quiet is the point.
+ */
+void xsc_cores_restrict(struct cpumask *mask)
+{
+	mutex_lock(&xsc_cores_lock);
+	if (!cpumask_empty(&xsc_syscall_cores) &&
+	    !cpumask_and(mask, mask, &xsc_syscall_cores))
+		cpumask_copy(mask, &xsc_syscall_cores);
+	mutex_unlock(&xsc_cores_lock);
+}
+
+static int xsc_core_load_show(struct seq_file *m, void *v)
+{
+	const struct cpumask *cpus;
+	struct xsc_core_stat *st;
+	int cpu;
+
+	mutex_lock(&xsc_cores_lock);
+	cpus = cpumask_empty(&xsc_syscall_cores) ? cpu_online_mask :
+						   &xsc_syscall_cores;
+	seq_puts(m, "cpu ops busy_ns\n");
+	for_each_cpu(cpu, cpus) {
+		st = per_cpu_ptr(&xsc_core_stat, cpu);
+		seq_printf(m, "%d %llu %llu\n", cpu, READ_ONCE(st->ops),
+			   READ_ONCE(st->busy_ns));
+	}
+	mutex_unlock(&xsc_cores_lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(xsc_core_load);
+
+void xsc_cores_debugfs_init(struct dentry *root)
+{
+	debugfs_create_file("core_load", 0444, root, NULL,
+			    &xsc_core_load_fops);
+}
+
+void __init xsc_cores_init(void)
+{
+	mutex_lock(&xsc_cores_lock);
+	xsc_cores_ready = true;
+	if (!cpumask_empty(&xsc_syscall_cores)) {
+		xsc_cores_check();
+		pr_info("xsc: syscall cores %*pbl\n",
+			cpumask_pr_args(&xsc_syscall_cores));
+	}
+	mutex_unlock(&xsc_cores_lock);
+}
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC cross-ring fairness
+ * Copyright (C) 2025
+ *
+ * v8-D §11: every ring's feeder and workers compete for the same cores
+ * (all of them, or the syscall cores). Without bounds, one process
+ * flooding its SQ keeps a kworker busy for as long as it keeps up, and
+ * other rings wait behind it. Two bounds keep tenants apart:
+ *
+ *   - a quantum: a ring's feeder consumes, and each of its worker slots
+ *     runs, at most fair_quantum SQEs/chains per turn before requeueing
+ *     itself behind other rings' work. The quantum scales with the ring
+ *     owner's cgroup cpu.weight (100 is the default weight), so a
+ *     heavier cgroup gets proportionally longer turns;
+ *   - a per-cgroup in-flight limit: with cgroup_inflight set, at most
+ *     that many chains from all rings of one cgroup are routed at once.
+ *     The rest stay deferred in their ring until the cgroup drops below
+ *     the limit, so a noisy tenant queues behind itself, not behind
+ *     everybody's workers.
+ *
+ * The cgroup is the ring owner's, looked up at setup.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/hashtable.h>
+#include <linux/refcount.h>
+#include <linux/cgroup.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+
+#include "xsc_internal.h"
+
+static unsigned int fair_quantum = 64;
+module_param(fair_quantum, uint, 0644);
+MODULE_PARM_DESC(fair_quantum,
+		 "SQEs or chains a ring runs per turn at cpu.weight 100");
+
+static unsigned int cgroup_inflight;
+module_param(cgroup_inflight, uint, 0644);
+MODULE_PARM_DESC(cgroup_inflight,
+		 "Chains in flight per cgroup across all rings (0: unlimited)");
+
+struct xsc_cg {
+	struct hlist_node	node;
+	u64			id;
+	refcount_t		ref;
+	atomic_t		inflight;
+	spinlock_t		lock;
+	struct list_head	waiters;	/* rings held back by the limit */
+};
+
+static DEFINE_HASHTABLE(xsc_cgs, 6);
+static DEFINE_SPINLOCK(xsc_cgs_lock);
+
+static u64 xsc_task_cgroup_id(struct task_struct *task)
+{
+#ifdef CONFIG_CGROUPS
+	u64 id;
+
+	rcu_read_lock();
+	id = cgroup_id(task_dfl_cgroup(task));
+	rcu_read_unlock();
+	return id;
+#else
+	return 0;
+#endif
+}
+
+static struct xsc_cg *xsc_cg_get(u64 id)
+{
+	struct xsc_cg *cg, *new;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	spin_lock(&xsc_cgs_lock);
+	hash_for_each_possible(xsc_cgs, cg, node, id) {
+		if (cg->id == id) {
+			refcount_inc(&cg->ref);
+			spin_unlock(&xsc_cgs_lock);
+			kfree(new);
+			return cg;
+		}
+	}
+
+	new->id = id;
+	refcount_set(&new->ref, 1);
+	atomic_set(&new->inflight, 0);
+	spin_lock_init(&new->lock);
+	INIT_LIST_HEAD(&new->waiters);
+	hash_add(xsc_cgs, &new->node, id);
+	spin_unlock(&xsc_cgs_lock);
+	return new;
+}
+
+static void xsc_cg_put(struct xsc_cg *cg)
+{
+	if (!refcount_dec_and_lock(&cg->ref, &xsc_cgs_lock))
+		return;
+	hash_del(&cg->node);
+	spin_unlock(&xsc_cgs_lock);
+	kfree(cg);
+}
+
+/*
+ * xsc_fair_quantum - SQEs or chains a ring may run in one turn
+ *
+ * Follows cpu.weight changes as they happen: the lookup is an RCU read.
+ */
+u32 xsc_fair_quantum(struct xsc_ctx *ctx)
+{
+	u64 q = (u64)READ_ONCE(fair_quantum) *
+		sched_task_cpu_weight(ctx->task);
+
+	return max_t(u32, div_u64(q, CGROUP_WEIGHT_DFL), 1);
+}
+
+/*
+ * xsc_fair_get - Take an in-flight slot for a chain about to be routed
+ *
+ * Called under the ring's sched_lock. On failure the ring is parked on
+ * its cgroup and resumed by xsc_fair_put() from whichever ring frees a
+ * slot.
+ */
+bool xsc_fair_get(struct xsc_ctx *ctx)
+{
+	struct xsc_cg *cg = ctx->fair_cg;
+	unsigned int limit = READ_ONCE(cgroup_inflight);
+	bool ok = true;
+
+	if (!limit) {
+		atomic_inc(&cg->inflight);
+		return true;
+	}
+
+	spin_lock(&cg->lock);
+	if (atomic_read(&cg->inflight) < limit) {
+		atomic_inc(&cg->inflight);
+	} else {
+		if (list_empty(&ctx->fair_node))
+			list_add_tail(&ctx->fair_node, &cg->waiters);
+		ok = false;
+	}
+	spin_unlock(&cg->lock);
+	return ok;
+}
+
+/*
+ * Resume the first parked ring of @cg that is not already on its way.
+ * Takes cg->lock with bottom halves off: it is also called from
+ * process context.
+ */
+static void xsc_fair_wake(struct xsc_cg *cg)
+{
+	struct xsc_ctx *next;
+
+	if (list_empty_careful(&cg->waiters))
+		return;
+
+	spin_lock_bh(&cg->lock);
+	while ((next = list_first_entry_or_null(&cg->waiters, struct xsc_ctx,
+						fair_node))) {
+		list_del_init(&next->fair_node);
+		if (queue_work(system_unbound_wq, &next->fair_work))
+			break;
+	}
+	spin_unlock_bh(&cg->lock);
+}
+
+/*
+ * A routed chain of @ctx is gone; called under its sched_lock. The slot
+ * goes to one parked ring, which hands it on in turn if it finds it has
+ * nothing left to route.
+ */
+void xsc_fair_put(struct xsc_ctx *ctx)
+{
+	struct xsc_cg *cg = ctx->fair_cg;
+
+	atomic_dec(&cg->inflight);
+	xsc_fair_wake(cg);
+}
+
+static void xsc_fair_resume(struct work_struct *work)
+{
+	struct xsc_ctx *ctx = container_of(work, struct xsc_ctx, fair_work);
+
+	if (!xsc_sched_resume(ctx))
+		xsc_fair_wake(ctx->fair_cg);
+}
+
+int xsc_fair_setup(struct xsc_ctx *ctx)
+{
+	ctx->fair_cg = xsc_cg_get(xsc_task_cgroup_id(ctx->task));
+	if (!ctx->fair_cg)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&ctx->fair_node);
+	INIT_WORK(&ctx->fair_work, xsc_fair_resume);
+	return 0;
+}
+
+/* Called once the ring can no longer route anything */
+void xsc_fair_release(struct xsc_ctx *ctx)
+{
+	struct xsc_cg *cg = ctx->fair_cg;
+
+	if (!cg)
+		return;
+
+	spin_lock_bh(&cg->lock);
+	list_del_init(&ctx->fair_node);
+	spin_unlock_bh(&cg->lock);
+	cancel_work_sync(&ctx->fair_work);
+
+	xsc_cg_put(cg);
+	ctx->fair_cg = NULL;
+}
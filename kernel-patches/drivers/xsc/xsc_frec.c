@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC flight recorder
+ * Copyright (C) 2025
+ *
+ * Always-on record of the last N ops each ring executed, for post-mortem
+ * analysis of latency spikes when tracing was off. Writers are lockless
+ * (see xsc_frec_record()); readers use the ring ioctl or debugfs at
+ * /sys/kernel/debug/xsc/ring-<id>/flight_recorder.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+
+#include "xsc_internal.h"
+
+static unsigned int flight_recorder_entries = 256;
+module_param(flight_recorder_entries, uint, 0444);
+MODULE_PARM_DESC(flight_recorder_entries,
+		 "Ops kept per ring by the flight recorder, rounded up to a power of 2 (0 disables)");
+
+static struct dentry *xsc_debugfs_root;
+
+int xsc_frec_alloc(struct xsc_ctx *ctx)
+{
+	unsigned int nr = flight_recorder_entries;
+
+	atomic_set(&ctx->frec_pos, 0);
+	if (!nr)
+		return 0;
+
+	nr = roundup_pow_of_two(min(nr, 65536U));
+	ctx->frec = kvcalloc(nr, sizeof(*ctx->frec), GFP_KERNEL);
+	if (!ctx->frec)
+		return -ENOMEM;
+	ctx->frec_mask = nr - 1;
+	return 0;
+}
+
+void xsc_frec_free(struct xsc_ctx *ctx)
+{
+	kvfree(ctx->frec);
+	ctx->frec = NULL;
+}
+
+/*
+ * xsc_frec_snapshot - Copy out the entry logged at @pos if still intact
+ */
+static bool xsc_frec_snapshot(struct xsc_ctx *ctx, u32 pos,
+			      struct xsc_frec_entry *out)
+{
+	struct xsc_frec_entry *e = &ctx->frec[pos & ctx->frec_mask];
+	u32 seq = pos * 2 + 2;
+
+	if (READ_ONCE(e->seq) != seq)
+		return false;
+	smp_rmb();
+	*out = *e;
+	smp_rmb();
+	return READ_ONCE(e->seq) == seq;
+}
+
+/* Returns the first position still held in the buffer */
+static u32 xsc_frec_window(struct xsc_ctx *ctx, u32 want, u32 *end)
+{
+	u32 pos = (u32)atomic_read(&ctx->frec_pos);
+	u32 nr = min(pos, ctx->frec_mask + 1);
+
+	*end = pos;
+	return pos - min(nr, want);
+}
+
+int xsc_frec_read(struct xsc_ctx *ctx, void __user *arg)
+{
+	struct xsc_frec_read rd;
+	struct xsc_frec_entry __user *uent;
+	struct xsc_frec_entry e;
+	u32 pos, end, copied = 0;
+
+	if (copy_from_user(&rd, arg, sizeof(rd)))
+		return -EFAULT;
+	if (rd.resv)
+		return -EINVAL;
+	if (!ctx->frec)
+		return -ENODEV;
+
+	uent = u64_to_user_ptr(rd.entries);
+	for (pos = xsc_frec_window(ctx, rd.nr, &end); pos != end; pos++) {
+		if (!xsc_frec_snapshot(ctx, pos, &e))
+			continue;
+		e.seq = 0;
+		if (copy_to_user(&uent[copied], &e, sizeof(e)))
+			return -EFAULT;
+		copied++;
+	}
+
+	rd.nr = copied;
+	if (copy_to_user(arg, &rd, sizeof(rd)))
+		return -EFAULT;
+	return 0;
+}
+
+static int xsc_frec_show(struct seq_file *m, void *v)
+{
+	struct xsc_ctx *ctx = m->private;
+	struct xsc_frec_entry e;
+	u32 pos, end;
+
+	seq_puts(m, "# dequeue_ns complete_ns cpu op fd res user_data\n");
+	for (pos = xsc_frec_window(ctx, U32_MAX, &end); pos != end; pos++) {
+		if (!xsc_frec_snapshot(ctx, pos, &e))
+			continue;
+		seq_printf(m, "%llu %llu %u %u %d %d 0x%llx\n",
+			   e.dequeue_ns, e.complete_ns, e.cpu, e.opcode,
+			   e.fd, e.res, e.user_data);
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(xsc_frec);
+
+void xsc_debugfs_ring_add(struct xsc_ctx *ctx)
+{
+	char name[32];
+
+	if (!xsc_debugfs_root || !ctx->frec)
+		return;
+
+	snprintf(name, sizeof(name), "ring-%u", ctx->id);
+	ctx->debugfs = debugfs_create_dir(name, xsc_debugfs_root);
+	debugfs_create_file("flight_recorder", 0400, ctx->debugfs, ctx,
+			    &xsc_frec_fops);
+}
+
+void xsc_debugfs_ring_remove(struct xsc_ctx *ctx)
+{
+	debugfs_remove_recursive(ctx->debugfs);
+	ctx->debugfs = NULL;
+}
+
+void xsc_debugfs_init(void)
+{
+	xsc_debugfs_root = debugfs_create_dir("xsc", NULL);
+	xsc_cores_debugfs_init(xsc_debugfs_root);
+}
+
+void xsc_debugfs_exit(void)
+{
+	debugfs_remove_recursive(xsc_debugfs_root);
+	xsc_debugfs_root = NULL;
+}
@@ -17,6 +17,19 @@
 #include <linux/audit.h>
 #endif
 #include <linux/uio.h>
+#include <linux/bitmap.h>
+#include <linux/jump_label.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/rbtree.h>
+#include <linux/xarray.h>
+#include <linux/refcount.h>
+#include <uapi/linux/sched/types.h>
 #include "xsc_uapi.h"
 
 /* v8-D §2.3: Resource Attribution & Accounting */
@@ -93,9 +106,126 @@ struct xsc_ring {
 	int			cqe_npages;
 };
 
+/* Per-ring restriction set, see XSC_IOC_REGISTER_RESTRICTIONS */
+#define XSC_RESTRICT_OPS	(XSC_RESTRICT_OP_WORDS * 64)
+
+struct xsc_restrict {
+	DECLARE_BITMAP(sqe_op, XSC_RESTRICT_OPS);
+	unsigned long		*file_slots;
+	u32			nr_file_slots;
+	u8			sqe_flags_allowed;
+	u8			sqe_flags_required;
+};
+
+/*
+ * Per-ring metrics. Counters and the ring-wide histograms are kept per
+ * CPU and summed on read; the per-opcode histograms, too large to copy
+ * for every CPU, are one atomic set per ring (ctx->op_hist).
+ *
+ * Latency histograms are log2 buckets: bucket 0 counts values below
+ * 2^(XSC_HIST_SHIFT + 1) ns, bucket i counts [2^(i+XSC_HIST_SHIFT),
+ * 2^(i+XSC_HIST_SHIFT+1)) ns and the last bucket is open-ended.
+ * Bucket counters are u32 and may wrap on very long-lived rings.
+ */
+#define XSC_HIST_SHIFT		9	/* bucket 1 starts at 1 us */
+#define XSC_HIST_BUCKETS	24	/* last bucket: >= ~4.3 s */
+#define XSC_BATCH_BUCKETS	13	/* last bucket: >= 4096 SQEs */
+
+struct xsc_op_hist {
+	atomic_t		wait[XSC_HIST_BUCKETS];		/* seen -> dequeue */
+	atomic_t		service[XSC_HIST_BUCKETS];	/* dispatch -> done */
+};
+
+struct xsc_metrics {
+	u64			submitted;	/* SQEs observed at tail */
+	u64			completed;	/* CQEs posted */
+	u64			inline_ops;	/* executed in submitter context */
+	u64			worker_ops;	/* executed by an XSC worker */
+	u64			overflows;	/* CQE posted into a full CQ */
+	u64			wakeups;	/* worker activations */
+	u32			wakeup_lat[XSC_HIST_BUCKETS];	/* kick -> worker */
+	u32			batch[XSC_BATCH_BUCKETS];	/* SQEs per tail scan */
+};
+
+/*
+ * Kernel-side request. The SQE is copied out of the shared ring when it
+ * is consumed, so userspace can reuse the slot right away and the op can
+ * run on whichever worker picks it up.
+ */
+struct xsc_req {
+	struct list_head	node;		/* domain queue, ctx->deferred or
+						 * ctx->running */
+	union {
+		struct list_head run_node;	/* ctx->runq[class] while ready */
+		struct rb_node	run_rb;		/* ctx->dl_runq[class], by deadline */
+	};
+	struct xsc_ctx		*ctx;
+	struct xsc_domain	*domain;	/* NULL: no ordering constraint */
+	struct xsc_req		*link;		/* next op of an XSC_F_LINK chain */
+	union {
+		struct timer_list expire;	/* chain heads with a deadline */
+		struct hrtimer	htimer;		/* XSC_OP_LINK_TIMEOUT, never a head */
+	};
+	struct task_struct	*task;		/* running: the executing worker */
+	struct xsc_req		*cur;		/* running: member being issued */
+	u64			seen_ns;	/* first observed in the SQ */
+	u64			deadline_ns;	/* 0: none */
+	u8			class;		/* XSC_CLASS_*, from sqe.ioprio */
+	u8			state;		/* XSC_REQ_*, under sched_lock */
+	bool			inline_exec;	/* run by the submitter */
+	bool			cancelled;	/* XSC_OP_ASYNC_CANCEL matched */
+	struct xsc_sqe		sqe;
+};
+
+/* Where a chain head is queued, so an expiring deadline can unlink it */
+enum {
+	XSC_REQ_DEFERRED,	/* ctx->deferred */
+	XSC_REQ_WAITING,	/* its domain's queue */
+	XSC_REQ_READY,		/* ctx->runq or ctx->dl_runq */
+	XSC_REQ_RUNNING,	/* owned by a worker, or being torn down */
+};
+
+/* Dispatch classes, following the SQE's ioprio class */
+enum {
+	XSC_CLASS_RT,
+	XSC_CLASS_BE,
+	XSC_CLASS_IDLE,
+	XSC_NR_CLASSES,
+};
+
+/*
+ * Ordering domains. Every fd with chains in flight has its own domain
+ * (fixed-file slots are a separate namespace), found through a small
+ * hash table; at most one op per domain is ready or running, so a
+ * domain's ops run in submission order while different fds run
+ * concurrently. A domain is freed with the last chain holding it.
+ */
+#define XSC_DOMAIN_BITS		6
+#define XSC_NR_DOMAINS		(1 << XSC_DOMAIN_BITS)	/* hash buckets */
+
+struct xsc_domain {
+	struct hlist_node	node;		/* ctx->domains bucket */
+	u32			key;		/* fd, BIT(31) for a fixed slot */
+	u32			refs;		/* chains submitted to it */
+	struct list_head	reqs;		/* waiting behind the busy one */
+	bool			busy;
+};
+
+/* One of a ring's max_workers execution slots */
+struct xsc_worker {
+	struct work_struct	work;
+	struct xsc_ctx		*ctx;
+	bool			active;		/* queued or running */
+
+	/* Origin's scheduling attributes while running (xsc_attribution.c) */
+	bool			sched_switched;
+	struct sched_attr	sched_prev;	/* the kworker's own */
+	struct sched_attr	sched_cur;	/* currently applied */
+};
+
 struct xsc_ctx {
 	struct xsc_ring		ring;
-	struct work_struct	sq_work;
+	struct work_struct	sq_work;	/* SQ feeder */
 	struct workqueue_struct	*wq;
 	spinlock_t		lock;
 	wait_queue_head_t	cq_wait;
@@ -103,7 +233,105 @@ struct xsc_ctx {
 	struct task_struct	*task;		/* Owner task */
 	struct files_struct	*files;		/* Owner files */
 	bool			polling;
-	int			cpu;
+	int			cpu;		/* placement anchor, -1: none */
+
+	/*
+	 * The file's reference plus one per zero-copy notification still
+	 * held by the network stack, which may post after close: the CQ
+	 * and metrics stay until the last is gone (xsc_ctx_put()).
+	 */
+	refcount_t		refs;
+	struct work_struct	free_work;
+
+	/* Worker placement (xsc_place.c) */
+	u32			placement;	/* XSC_PLACE_* */
+	u32			place_misses;	/* kicks from outside the anchor */
+	int			place_next;
+	struct work_struct	place_work;
+
+	/*
+	 * Lock-free CQ posting (xsc_post_cqe): next slot to hand out and
+	 * the tail published so far. On their own cache line since every
+	 * completer hits them.
+	 */
+	u32			cq_claim ____cacheline_aligned_in_smp;
+	u32			cq_committed;
+
+	/* Parallel execution (xsc_sched.c), protected by sched_lock */
+	spinlock_t		sched_lock ____cacheline_aligned_in_smp;
+	struct hlist_head	*domains;	/* [XSC_NR_DOMAINS] */
+	struct xsc_domain	*domain_spare;	/* feeder's, filled outside */
+	struct list_head	runq[XSC_NR_CLASSES];	/* ready requests */
+	struct rb_root_cached	dl_runq[XSC_NR_CLASSES]; /* ready, with deadline */
+	struct xsc_worker	*workers;
+	u32			nr_workers;
+	struct list_head	deferred;	/* held back by XSC_F_DRAIN */
+	struct list_head	running;	/* chain heads on a worker */
+	u32			inflight;	/* chains routed, not yet done */
+	bool			drain_running;
+	bool			sched_dying;	/* expiry leaves reqs to release */
+	struct xsc_cg		*fair_cg;	/* owner's cgroup (xsc_fair.c) */
+	struct list_head	fair_node;	/* on fair_cg's waiters */
+	struct work_struct	fair_work;	/* resume after the limit */
+
+	/* Armed XSC_OP_TIMEOUTs (xsc_timeout.c) */
+	spinlock_t		timeout_lock;
+	struct list_head	timeouts;
+
+	/* Armed XSC_OP_POLL_ADDs (xsc_poll.c) */
+	spinlock_t		poll_lock;
+	struct list_head	polls;
+	struct xsc_req		*link_head;	/* open chain, under sq_lock */
+	struct xsc_req		*link_tail;
+
+	/*
+	 * Execution mode controller (xsc_sched.c). sq_lock serializes SQ
+	 * consumption between the feeder and inline submission.
+	 */
+	struct mutex		sq_lock;
+	u64			sq_consumed;	/* under sq_lock */
+	atomic64_t		busy_ns;	/* worker time executing ops */
+	u8			exec_mode;	/* XSC_EXEC_* */
+	u8			exec_next;	/* mode being voted for */
+	u8			exec_votes;
+	bool			place_pinned;	/* placement set at setup */
+	u64			exec_window_ns;
+	u64			exec_last_consumed;
+	u64			exec_last_busy;
+	u64			exec_rate;	/* SQEs/s, EWMA */
+
+	/*
+	 * Fixed files (XSC_IOC_REGISTER_FILES): XSC_MAX_FIXED_FILES slots,
+	 * updated under files_lock, looked up under RCU.
+	 */
+	struct mutex		files_lock;
+	struct file		**fixed_files;
+
+	/* Provided buffer groups by bgid (xsc_buf.c) */
+	struct mutex		buf_lock;
+	struct xarray		buf_groups;
+	u32			nr_buf_groups;
+
+	/* Observability */
+	u32			id;		/* stable ring id for tools */
+	struct list_head	node;		/* xsc_ctx_list */
+	struct xsc_metrics __percpu *metrics;
+	struct xsc_op_hist	*op_hist;	/* [XSC_OP_LAST] */
+	u64			kick_ns;	/* last submission kick */
+	u32			cq_reaped;	/* CQ head last seen by xsc_reap */
+
+	/* Flight recorder of recently completed ops */
+	struct xsc_frec_entry	*frec;
+	u32			frec_mask;
+	atomic_t		frec_pos;
+	struct dentry		*debugfs;
+
+	/* Summary-mode audit state, allocated on first aggregated op */
+	struct xsc_audit_agg	*audit_agg;
+
+	/* Set once by XSC_IOC_REGISTER_RESTRICTIONS, never cleared */
+	bool			restricted;
+	struct xsc_restrict	restrictions;
 };
 
 /* Dispatch functions */
@@ -113,10 +341,85 @@ int xsc_dispatch_timer(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe
 int xsc_dispatch_sync(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cqe);
 int xsc_dispatch_exec(struct xsc_ctx *ctx, struct xsc_sqe *sqe, struct xsc_cqe *cqe);
 
+/* Execution modes, picked per ring from load (xsc_exec_update()) */
+enum {
+	XSC_EXEC_INLINE,	/* submitter runs its own SQEs in xsc_write() */
+	XSC_EXEC_SIBLING,	/* workers on the submitter's SMT siblings */
+	XSC_EXEC_REMOTE,	/* workers on other (or dedicated) cores */
+};
+
+/*
+ * Handlers reach user memory through the ring owner's mm. Workers are
+ * kthreads and adopt it; inline execution already runs on it.
+ */
+static inline void xsc_use_mm(struct mm_struct *mm)
+{
+	if (current->flags & PF_KTHREAD)
+		kthread_use_mm(mm);
+}
+
+static inline void xsc_unuse_mm(struct mm_struct *mm)
+{
+	if (current->flags & PF_KTHREAD)
+		kthread_unuse_mm(mm);
+}
+
+/* Request execution (xsc_core.c) and scheduling (xsc_sched.c) */
+void xsc_post_cqe(struct xsc_ctx *ctx, u8 opcode, u64 user_data, s32 res,
+		  u32 cflags);
+void xsc_ctx_put(struct xsc_ctx *ctx);
+
+static inline void xsc_ctx_get(struct xsc_ctx *ctx)
+{
+	refcount_inc(&ctx->refs);
+}
+int xsc_issue_req(struct xsc_ctx *ctx, struct xsc_req *req);
+void xsc_sched_init(void);
+int xsc_sched_setup(struct xsc_ctx *ctx, u32 max_workers);
+void xsc_sched_release(struct xsc_ctx *ctx);
+int xsc_sched_submit(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+		     u64 seen_ns);
+bool xsc_sched_idle(struct xsc_ctx *ctx);
+bool xsc_sched_resume(struct xsc_ctx *ctx);
+int xsc_sched_cancel(struct xsc_ctx *ctx, const struct xsc_sqe *sqe);
+int xsc_ltimeout_arm(struct xsc_ctx *ctx, struct xsc_req *lt,
+		     struct xsc_req *target);
+bool xsc_ltimeout_disarm(struct xsc_req *lt);
+int xsc_timeout_start(struct xsc_ctx *ctx, const struct xsc_sqe *sqe);
+int xsc_timeout_cancel(struct xsc_ctx *ctx, u64 user_data, u32 cancel_flags);
+void xsc_timeout_release(struct xsc_ctx *ctx);
+int xsc_poll_add(struct xsc_ctx *ctx, const struct xsc_sqe *sqe);
+int xsc_poll_remove(struct xsc_ctx *ctx, const struct xsc_sqe *sqe);
+int xsc_poll_cancel(struct xsc_ctx *ctx, u64 user_data, s32 fd, bool fixed,
+		    u32 cancel_flags);
+int xsc_poll_arm_op(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+		    struct file *file, __poll_t events,
+		    int (*issue)(struct xsc_ctx *, const struct xsc_sqe *,
+				 struct file *, u32 *));
+void xsc_poll_release(struct xsc_ctx *ctx);
+
+static inline void xsc_complete_cqe(struct xsc_ctx *ctx, u8 opcode,
+				    u64 user_data, s32 res)
+{
+	xsc_post_cqe(ctx, opcode, user_data, res, 0);
+}
+void xsc_exec_setup(struct xsc_ctx *ctx, bool place_pinned);
+void xsc_exec_update(struct xsc_ctx *ctx, u64 now);
+const char *xsc_exec_mode_name(u8 mode);
+
+/* v8-D §11: Cross-ring fairness (xsc_fair.c) */
+int xsc_fair_setup(struct xsc_ctx *ctx);
+void xsc_fair_release(struct xsc_ctx *ctx);
+u32 xsc_fair_quantum(struct xsc_ctx *ctx);
+bool xsc_fair_get(struct xsc_ctx *ctx);
+void xsc_fair_put(struct xsc_ctx *ctx);
+
 /* v8-D §2.3: Resource Attribution Wrapper */
 void xsc_run_with_attribution(struct xsc_ctx *ctx,
 		       struct xsc_task_cred *tc,
 		       void (*fn)(void *), void *arg);
+void xsc_sched_inherit(struct xsc_worker *w, struct task_struct *origin);
+void xsc_sched_restore(struct xsc_worker *w);
 
 /* v8-D §2.5: CQE Write with Batched STAC/CLAC */
 int xsc_cqe_write(struct xsc_ctx *ctx, struct xsc_cqe *cqe, u32 cq_idx);
@@ -128,20 +431,226 @@ void xsc_uvec_cleanup(struct xsc_uvec *uv);
 /* v8-D §5: Observability - Tracepoints & Audit */
 void xsc_trace_sys_enter(struct xsc_tp_enter *tpe);
 void xsc_trace_sys_exit(struct xsc_tp_exit *tpx);
+
+enum {
+	XSC_AUDIT_SKIP,		/* audit disabled */
+	XSC_AUDIT_RECORD,	/* per-op submit/result records */
+	XSC_AUDIT_SUMMARY,	/* folded into the ring's interval summary */
+};
+
+#ifdef CONFIG_AUDIT
+DECLARE_STATIC_KEY_FALSE(xsc_audit_key);
+
+static inline bool xsc_audit_enabled(void)
+{
+	return static_branch_unlikely(&xsc_audit_key);
+}
+
+void xsc_audit_init(void);
 void xsc_audit_submit(struct xsc_task_cred *tc, u64 nr, u64 *args);
 void xsc_audit_result(struct xsc_task_cred *tc, s64 ret);
+int xsc_audit_classify(struct xsc_ctx *ctx, const struct xsc_sqe *sqe);
+void xsc_audit_account(struct xsc_ctx *ctx, struct xsc_task_cred *tc,
+		       const struct xsc_sqe *sqe, s64 ret);
+void xsc_audit_ring_release(struct xsc_ctx *ctx);
+#else
+static inline bool xsc_audit_enabled(void) { return false; }
+static inline void xsc_audit_init(void) { }
+static inline void xsc_audit_submit(struct xsc_task_cred *tc, u64 nr,
+				    u64 *args) { }
+static inline void xsc_audit_result(struct xsc_task_cred *tc, s64 ret) { }
+static inline int xsc_audit_classify(struct xsc_ctx *ctx,
+				     const struct xsc_sqe *sqe)
+{
+	return XSC_AUDIT_SKIP;
+}
+static inline void xsc_audit_account(struct xsc_ctx *ctx,
+				     struct xsc_task_cred *tc,
+				     const struct xsc_sqe *sqe, s64 ret) { }
+static inline void xsc_audit_ring_release(struct xsc_ctx *ctx) { }
+#endif
+
+/*
+ * xsc_sqe_args - Canonical syscall-style argument vector of an SQE
+ *
+ * Shared by seccomp, tracing and audit so all three see the same view.
+ */
+static inline void xsc_sqe_args(const struct xsc_sqe *sqe, u64 *args)
+{
+	args[0] = (u64)(s64)sqe->fd;
+	args[1] = sqe->addr;
+	args[2] = sqe->len;
+	args[3] = sqe->off;
+	args[4] = sqe->rw_flags;
+	args[5] = (u64)(s64)sqe->splice_fd_in;
+}
 
 /* v8-D §8.4: Lifecycle - Signals, Cancellation, Exec */
 int xsc_check_signals(struct xsc_ctx *ctx);
 void xsc_exec_barrier(struct xsc_ctx *ctx);
 void xsc_cancel_pending_sqes(struct xsc_ctx *ctx);
 
+/* Fixed files and ring restrictions */
+int xsc_register_files(struct xsc_ctx *ctx, void __user *arg);
+int xsc_unregister_files(struct xsc_ctx *ctx);
+void xsc_free_files(struct xsc_ctx *ctx);
+struct file *xsc_get_file(struct xsc_ctx *ctx, struct xsc_sqe *sqe);
+struct file *xsc_get_file_in(struct xsc_ctx *ctx, struct xsc_sqe *sqe);
+int xsc_register_restrictions(struct xsc_ctx *ctx, void __user *arg);
+void xsc_free_restrictions(struct xsc_ctx *ctx);
+
+/* Provided buffers (xsc_buf.c) */
+struct xsc_buf {
+	u64			addr;
+	u32			len;
+	u16			bid;
+};
+
+int xsc_provide_buffers(struct xsc_ctx *ctx, void __user *arg);
+bool xsc_buf_select(struct xsc_ctx *ctx, u16 bgid, struct xsc_buf *buf);
+void xsc_buf_recycle(struct xsc_ctx *ctx, u16 bgid, const struct xsc_buf *buf);
+void xsc_buf_consumed(struct xsc_ctx *ctx, u16 bgid);
+void xsc_buf_release(struct xsc_ctx *ctx);
+
+static inline u32 xsc_buf_cflags(const struct xsc_buf *buf)
+{
+	return XSC_CQE_F_BUFFER | (u32)buf->bid << XSC_CQE_BUFFER_SHIFT;
+}
+
+/*
+ * xsc_check_restrictions - O(1) policy test at dequeue
+ *
+ * A handful of bit tests against the registered set; unrestricted
+ * rings pay a single load.
+ */
+static inline int xsc_check_restrictions(struct xsc_ctx *ctx,
+					 const struct xsc_sqe *sqe)
+{
+	const struct xsc_restrict *r = &ctx->restrictions;
+
+	/* Pairs with smp_store_release() in xsc_register_restrictions() */
+	if (likely(!smp_load_acquire(&ctx->restricted)))
+		return 0;
+
+	if (!test_bit(sqe->opcode, r->sqe_op))
+		return -EACCES;
+	if (sqe->flags & ~r->sqe_flags_allowed)
+		return -EACCES;
+	if ((sqe->flags & r->sqe_flags_required) != r->sqe_flags_required)
+		return -EACCES;
+	if (r->nr_file_slots && (sqe->flags & XSC_F_FIXED_FILE)) {
+		if ((u32)sqe->fd >= r->nr_file_slots ||
+		    !test_bit(sqe->fd, r->file_slots))
+			return -EACCES;
+	}
+	return 0;
+}
+
+/* Ring registry and metrics */
+void xsc_ctx_register(struct xsc_ctx *ctx);
+void xsc_ctx_unregister(struct xsc_ctx *ctx);
+void xsc_ctx_for_each(void (*fn)(struct xsc_ctx *ctx, void *arg), void *arg);
+int xsc_metrics_alloc(struct xsc_ctx *ctx);
+void xsc_metrics_free(struct xsc_ctx *ctx);
+void xsc_metrics_show(struct seq_file *m, struct xsc_ctx *ctx);
+int xsc_proc_show_metrics(struct seq_file *m, struct task_struct *task);
+
+/* Flight recorder */
+int xsc_frec_alloc(struct xsc_ctx *ctx);
+void xsc_frec_free(struct xsc_ctx *ctx);
+int xsc_frec_read(struct xsc_ctx *ctx, void __user *arg);
+void xsc_debugfs_ring_add(struct xsc_ctx *ctx);
+void xsc_debugfs_ring_remove(struct xsc_ctx *ctx);
+void xsc_debugfs_init(void);
+void xsc_debugfs_exit(void);
+
+/*
+ * xsc_frec_record - Log one completed op
+ *
+ * Lockless: one atomic slot claim plus a handful of stores, bracketed by
+ * a per-entry sequence so readers can drop entries torn by a wrap.
+ */
+static inline void xsc_frec_record(struct xsc_ctx *ctx,
+				   const struct xsc_sqe *sqe, s32 res,
+				   u64 dequeue_ns, u64 complete_ns)
+{
+	struct xsc_frec_entry *e;
+	u32 pos;
+
+	if (!ctx->frec)
+		return;
+
+	pos = (u32)atomic_fetch_inc(&ctx->frec_pos);
+	e = &ctx->frec[pos & ctx->frec_mask];
+
+	WRITE_ONCE(e->seq, pos * 2 + 1);
+	smp_wmb();
+	e->user_data = sqe->user_data;
+	e->dequeue_ns = dequeue_ns;
+	e->complete_ns = complete_ns;
+	e->fd = sqe->fd;
+	e->res = res;
+	e->opcode = sqe->opcode;
+	e->cpu = raw_smp_processor_id();
+	smp_wmb();
+	WRITE_ONCE(e->seq, pos * 2 + 2);
+}
+
+static inline unsigned int xsc_hist_bucket(u64 ns)
+{
+	unsigned int b;
+
+	ns >>= XSC_HIST_SHIFT;
+	if (!ns)
+		return 0;
+	b = ilog2(ns);
+	return min_t(unsigned int, b, XSC_HIST_BUCKETS - 1);
+}
+
+static inline void xsc_metrics_batch(struct xsc_ctx *ctx, u32 nr)
+{
+	unsigned int b = min_t(unsigned int, ilog2(nr ?: 1),
+			       XSC_BATCH_BUCKETS - 1);
+
+	this_cpu_add(ctx->metrics->submitted, nr);
+	this_cpu_inc(ctx->metrics->batch[b]);
+}
+
+static inline void xsc_metrics_op(struct xsc_ctx *ctx, u8 opcode,
+				  u64 wait_ns, u64 service_ns)
+{
+	if (opcode >= XSC_OP_LAST)
+		return;
+	atomic_inc(&ctx->op_hist[opcode].wait[xsc_hist_bucket(wait_ns)]);
+	atomic_inc(&ctx->op_hist[opcode].service[xsc_hist_bucket(service_ns)]);
+}
+
 /* v8-D §5.3: Seccomp at Consume */
 int xsc_seccomp_check(struct xsc_task_cred *tc, u64 nr, u64 *args);
 
-/* v8-D §10: SMT Isolation */
-int xsc_worker_set_affinity(struct xsc_ctx *ctx, struct task_struct *worker);
-void xsc_worker_clear_affinity(struct task_struct *worker);
+/* v8-D §10: Worker placement */
+void xsc_place_setup(struct xsc_ctx *ctx, u32 policy);
+void xsc_place_switch(struct xsc_ctx *ctx, u32 policy);
+void xsc_place_reapply(struct xsc_ctx *ctx);
+void xsc_place_note_cpu(struct xsc_ctx *ctx, int cpu);
+void xsc_place_release(struct xsc_ctx *ctx);
+
+/* Dedicated syscall cores (xsc_cores.c) */
+struct xsc_core_stat {
+	u64	ops;
+	u64	busy_ns;
+};
+DECLARE_PER_CPU(struct xsc_core_stat, xsc_core_stat);
+
+static inline void xsc_core_account(u64 busy_ns)
+{
+	this_cpu_inc(xsc_core_stat.ops);
+	this_cpu_add(xsc_core_stat.busy_ns, busy_ns);
+}
+
+void xsc_cores_init(void);
+void xsc_cores_restrict(struct cpumask *mask);
+void xsc_cores_debugfs_init(struct dentry *root);
 
 /* v8-D §2.4: User-memory copy helpers */
 int xsc_uvec_copy_to_user(struct xsc_uvec *uv, const void *src, size_t len);
@@ -168,6 +677,7 @@ void xsc_task_cred_snapshot(struct xsc_task_cred *tc, struct task_struct *origin
 void xsc_task_cred_release(struct xsc_task_cred *tc);
 int xsc_check_rlimit(struct xsc_task_cred *tc, unsigned int resource,
 		     unsigned long value);
+int xsc_check_ioprio(struct xsc_task_cred *tc, u16 ioprio);
 
 /* v8-D §2.5: CQE batch write */
 int xsc_cqe_write_batch(struct xsc_ctx *ctx, struct xsc_cqe *cqes,
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC per-ring metrics (v7-D §7.1)
+ * Copyright (C) 2025
+ *
+ * Counters and the ring-wide log2 histograms live in per-CPU buffers so
+ * the worker never contends on them; readers sum across CPUs. The
+ * per-opcode histograms would make that ~9 KB per CPU per ring, so they
+ * are a single set of atomics per ring instead: workers only share a
+ * cache line when they finish the same opcode. Exposed in the ring's
+ * fdinfo and in /proc/<pid>/xsc/metrics.
+ *
+ * Queue wait is measured from the moment the kernel first observes an
+ * SQE at the tail to its dequeue, and service time from dispatch to
+ * handler return. Together with the worker wakeup latency this tells
+ * a slow device (high service) from a starved worker (high wait/wakeup).
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/seq_file.h>
+#include <linux/sched.h>
+
+#include "xsc_internal.h"
+
+static LIST_HEAD(xsc_ctx_list);
+static DEFINE_MUTEX(xsc_ctx_list_lock);
+static atomic_t xsc_ctx_next_id = ATOMIC_INIT(0);
+
+void xsc_ctx_register(struct xsc_ctx *ctx)
+{
+	ctx->id = atomic_inc_return(&xsc_ctx_next_id);
+
+	mutex_lock(&xsc_ctx_list_lock);
+	list_add_tail(&ctx->node, &xsc_ctx_list);
+	mutex_unlock(&xsc_ctx_list_lock);
+}
+
+void xsc_ctx_unregister(struct xsc_ctx *ctx)
+{
+	mutex_lock(&xsc_ctx_list_lock);
+	list_del_init(&ctx->node);
+	mutex_unlock(&xsc_ctx_list_lock);
+}
+
+/* Call @fn on every open ring, under the ring list lock */
+void xsc_ctx_for_each(void (*fn)(struct xsc_ctx *ctx, void *arg), void *arg)
+{
+	struct xsc_ctx *ctx;
+
+	mutex_lock(&xsc_ctx_list_lock);
+	list_for_each_entry(ctx, &xsc_ctx_list, node)
+		fn(ctx, arg);
+	mutex_unlock(&xsc_ctx_list_lock);
+}
+
+int xsc_metrics_alloc(struct xsc_ctx *ctx)
+{
+	ctx->metrics = alloc_percpu(struct xsc_metrics);
+	ctx->op_hist = kvcalloc(XSC_OP_LAST, sizeof(*ctx->op_hist),
+				GFP_KERNEL_ACCOUNT);
+	if (!ctx->metrics || !ctx->op_hist) {
+		xsc_metrics_free(ctx);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void xsc_metrics_free(struct xsc_ctx *ctx)
+{
+	free_percpu(ctx->metrics);
+	ctx->metrics = NULL;
+	kvfree(ctx->op_hist);
+	ctx->op_hist = NULL;
+}
+
+static void xsc_metrics_sum(struct xsc_ctx *ctx, struct xsc_metrics *sum)
+{
+	int cpu, b;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct xsc_metrics *m = per_cpu_ptr(ctx->metrics, cpu);
+
+		sum->submitted += m->submitted;
+		sum->completed += m->completed;
+		sum->inline_ops += m->inline_ops;
+		sum->worker_ops += m->worker_ops;
+		sum->overflows += m->overflows;
+		sum->wakeups += m->wakeups;
+		for (b = 0; b < XSC_HIST_BUCKETS; b++)
+			sum->wakeup_lat[b] += m->wakeup_lat[b];
+		for (b = 0; b < XSC_BATCH_BUCKETS; b++)
+			sum->batch[b] += m->batch[b];
+	}
+}
+
+static void xsc_hist_read(const atomic_t *hist, u32 *out, int nr)
+{
+	while (nr--)
+		out[nr] = atomic_read(&hist[nr]);
+}
+
+static void xsc_seq_hist(struct seq_file *m, const char *name,
+			 const u32 *hist, int nr)
+{
+	int b;
+
+	seq_printf(m, "%s:", name);
+	for (b = 0; b < nr; b++)
+		seq_printf(m, " %u", hist[b]);
+	seq_putc(m, '\n');
+}
+
+static bool xsc_hist_empty(const u32 *hist, int nr)
+{
+	while (nr--)
+		if (hist[nr])
+			return false;
+	return true;
+}
+
+/*
+ * xsc_metrics_show - Print one ring's metrics
+ *
+ * Histograms are printed as bucket counts, lowest bucket first; see
+ * struct xsc_metrics for the bucket boundaries. Opcodes that never
+ * ran are omitted.
+ */
+void xsc_metrics_show(struct seq_file *m, struct xsc_ctx *ctx)
+{
+	u32 wait[XSC_HIST_BUCKETS], service[XSC_HIST_BUCKETS];
+	struct xsc_metrics *sum;
+	char name[32];
+	int i;
+
+	if (!ctx->metrics)
+		return;
+
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return;
+
+	xsc_metrics_sum(ctx, sum);
+
+	seq_printf(m, "ring:\t%u\n", ctx->id);
+	seq_printf(m, "exec_mode:\t%s\n",
+		   xsc_exec_mode_name(READ_ONCE(ctx->exec_mode)));
+	seq_printf(m, "submitted:\t%llu\n", sum->submitted);
+	seq_printf(m, "completed:\t%llu\n", sum->completed);
+	seq_printf(m, "inline:\t%llu\n", sum->inline_ops);
+	seq_printf(m, "worker:\t%llu\n", sum->worker_ops);
+	seq_printf(m, "overflows:\t%llu\n", sum->overflows);
+	seq_printf(m, "wakeups:\t%llu\n", sum->wakeups);
+	xsc_seq_hist(m, "wakeup_ns_log2", sum->wakeup_lat, XSC_HIST_BUCKETS);
+	xsc_seq_hist(m, "batch_log2", sum->batch, XSC_BATCH_BUCKETS);
+
+	for (i = 0; i < XSC_OP_LAST; i++) {
+		xsc_hist_read(ctx->op_hist[i].service, service,
+			      XSC_HIST_BUCKETS);
+		if (xsc_hist_empty(service, XSC_HIST_BUCKETS))
+			continue;
+		xsc_hist_read(ctx->op_hist[i].wait, wait, XSC_HIST_BUCKETS);
+		snprintf(name, sizeof(name), "op%d_wait_ns_log2", i);
+		xsc_seq_hist(m, name, wait, XSC_HIST_BUCKETS);
+		snprintf(name, sizeof(name), "op%d_service_ns_log2", i);
+		xsc_seq_hist(m, name, service, XSC_HIST_BUCKETS);
+	}
+
+	kfree(sum);
+}
+
+/*
+ * xsc_proc_show_metrics - /proc/<pid>/xsc/metrics
+ *
+ * Called from fs/proc/base.c (see kernel-patches/fs/proc-xsc.patch).
+ * Lists every ring owned by the task's thread group.
+ */
+int xsc_proc_show_metrics(struct seq_file *m, struct task_struct *task)
+{
+	struct xsc_ctx *ctx;
+
+	mutex_lock(&xsc_ctx_list_lock);
+	list_for_each_entry(ctx, &xsc_ctx_list, node) {
+		if (!same_thread_group(ctx->task, task))
+			continue;
+		xsc_metrics_show(m, ctx);
+		seq_putc(m, '\n');
+	}
+	mutex_unlock(&xsc_ctx_list_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xsc_proc_show_metrics);
@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC worker placement
+ * Copyright (C) 2025
+ *
+ * v8-D §10: where a ring's workers run relative to the submitting task.
+ * Placement is a property of the ring's unbound workqueue (its cpumask),
+ * so kworkers keep it across activations instead of paying for
+ * set_cpus_allowed_ptr() on every run. Policies, picked per ring at
+ * XSC_IOC_SETUP or by default from xsc.placement:
+ *
+ *   any      - no constraint
+ *   sibling  - the submitter's core (SMT siblings): lowest latency
+ *   llc      - the submitter's LLC, other cores
+ *   isolate  - any core but the submitter's: no shared SMT state
+ *
+ * The anchor is the CPU the ring was set up on. Kicks from xsc_write()
+ * note the submitter's CPU; once XSC_PLACE_MIGRATE_KICKS kicks in a row
+ * come from outside the anchor's core (or LLC, for "llc") the task has
+ * moved for good and the workqueue is re-placed around the new CPU.
+ *
+ * Dedicated syscall cores (xsc_cores.c), when set, further confine the
+ * mask of every policy.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "xsc_internal.h"
+
+#define XSC_PLACE_MIGRATE_KICKS	16
+
+static const char * const xsc_place_names[] = {
+	[XSC_PLACE_ANY]		= "any",
+	[XSC_PLACE_SIBLING]	= "sibling",
+	[XSC_PLACE_LLC]		= "llc",
+	[XSC_PLACE_ISOLATE]	= "isolate",
+};
+
+static int xsc_placement = XSC_PLACE_ISOLATE;
+
+static int xsc_placement_set(const char *val, const struct kernel_param *kp)
+{
+	int i;
+
+	for (i = XSC_PLACE_ANY; i < ARRAY_SIZE(xsc_place_names); i++) {
+		if (sysfs_streq(val, xsc_place_names[i])) {
+			WRITE_ONCE(xsc_placement, i);
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+static int xsc_placement_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%s\n", xsc_place_names[READ_ONCE(xsc_placement)]);
+}
+
+static const struct kernel_param_ops xsc_placement_ops = {
+	.set	= xsc_placement_set,
+	.get	= xsc_placement_get,
+};
+module_param_cb(placement, &xsc_placement_ops, NULL, 0644);
+MODULE_PARM_DESC(placement,
+		 "Default worker placement: any, sibling, llc, isolate");
+
+static void xsc_place_mask(int policy, int cpu, struct cpumask *mask)
+{
+	const struct cpumask *core = topology_sibling_cpumask(cpu);
+
+	switch (policy) {
+	case XSC_PLACE_SIBLING:
+		cpumask_copy(mask, core);
+		break;
+	case XSC_PLACE_LLC:
+		cpumask_andnot(mask, cpu_coregroup_mask(cpu), core);
+		break;
+	case XSC_PLACE_ISOLATE:
+		cpumask_andnot(mask, cpu_online_mask, core);
+		break;
+	default:
+		cpumask_copy(mask, cpu_possible_mask);
+		break;
+	}
+
+	/* No SMT, single-core LLC, or a one-CPU box: run anywhere */
+	if (policy != XSC_PLACE_ANY && !cpumask_and(mask, mask, cpu_online_mask))
+		cpumask_copy(mask, cpu_possible_mask);
+
+	xsc_cores_restrict(mask);
+}
+
+/* Whether @cpu is still within the unit the placement was built around */
+static bool xsc_place_same_unit(int policy, int anchor, int cpu)
+{
+	if (policy == XSC_PLACE_LLC)
+		return cpus_share_cache(anchor, cpu);
+	return cpumask_test_cpu(cpu, topology_sibling_cpumask(anchor));
+}
+
+static int xsc_place_apply(struct xsc_ctx *ctx, int cpu)
+{
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = alloc_workqueue_attrs();
+	if (!attrs)
+		return -ENOMEM;
+
+	/* Keep WQ_HIGHPRI's nice level; apply replaces all attributes */
+	attrs->nice = MIN_NICE;
+	xsc_place_mask(ctx->placement, cpu, attrs->cpumask);
+
+	ret = apply_workqueue_attrs(ctx->wq, attrs);
+	free_workqueue_attrs(attrs);
+	if (!ret && ctx->placement != XSC_PLACE_ANY)
+		WRITE_ONCE(ctx->cpu, cpu);
+	return ret;
+}
+
+static void xsc_place_work(struct work_struct *work)
+{
+	struct xsc_ctx *ctx = container_of(work, struct xsc_ctx, place_work);
+
+	xsc_place_apply(ctx, READ_ONCE(ctx->place_next));
+}
+
+/*
+ * xsc_place_setup - Place a ring's workqueue around the calling CPU
+ *
+ * Best effort: a ring whose placement cannot be applied still works,
+ * just without the topology constraint.
+ */
+void xsc_place_setup(struct xsc_ctx *ctx, u32 policy)
+{
+	int ret;
+
+	if (policy == XSC_PLACE_DEFAULT || policy > XSC_PLACE_ISOLATE)
+		policy = READ_ONCE(xsc_placement);
+	ctx->placement = policy;
+	INIT_WORK(&ctx->place_work, xsc_place_work);
+
+	ret = xsc_place_apply(ctx, raw_smp_processor_id());
+	if (ret)
+		pr_warn_ratelimited("xsc: ring %u: placement %s not applied: %d\n",
+				    ctx->id, xsc_place_names[policy], ret);
+}
+
+/*
+ * xsc_place_switch - Move a live ring to another policy
+ *
+ * Used by the execution mode controller from xsc_write(), so the
+ * current CPU is the submitter's and becomes the new anchor.
+ */
+void xsc_place_switch(struct xsc_ctx *ctx, u32 policy)
+{
+	if (READ_ONCE(ctx->placement) == policy)
+		return;
+
+	WRITE_ONCE(ctx->placement, policy);
+	WRITE_ONCE(ctx->place_next, raw_smp_processor_id());
+	schedule_work(&ctx->place_work);
+}
+
+/*
+ * xsc_place_reapply - Recompute a live ring's placement
+ *
+ * Used when the dedicated syscall cores change.
+ */
+void xsc_place_reapply(struct xsc_ctx *ctx)
+{
+	int cpu = READ_ONCE(ctx->cpu);
+
+	if (!READ_ONCE(ctx->wq))
+		return;
+	xsc_place_apply(ctx, cpu >= 0 ? cpu : raw_smp_processor_id());
+}
+
+/*
+ * xsc_place_note_cpu - Track the submitter's CPU at kick time
+ *
+ * Called from xsc_write(). Racy by design: misses is a heuristic and a
+ * lost update only delays re-placement by a kick.
+ */
+void xsc_place_note_cpu(struct xsc_ctx *ctx, int cpu)
+{
+	int anchor = READ_ONCE(ctx->cpu);
+
+	if (ctx->placement == XSC_PLACE_ANY || anchor < 0)
+		return;
+
+	if (xsc_place_same_unit(ctx->placement, anchor, cpu)) {
+		if (ctx->place_misses)
+			WRITE_ONCE(ctx->place_misses, 0);
+		return;
+	}
+
+	if (++ctx->place_misses < XSC_PLACE_MIGRATE_KICKS)
+		return;
+
+	ctx->place_misses = 0;
+	WRITE_ONCE(ctx->place_next, cpu);
+	schedule_work(&ctx->place_work);
+}
+
+void xsc_place_release(struct xsc_ctx *ctx)
+{
+	if (ctx->wq)
+		cancel_work_sync(&ctx->place_work);
+}
@@ -0,0 +1,530 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC readiness notifications
+ * Copyright (C) 2025
+ *
+ * XSC_OP_POLL and XSC_OP_EPOLL_WAIT sleep in a worker until something is
+ * ready. XSC_OP_POLL_ADD instead hooks an entry onto the file's wait
+ * queue(s) through vfs_poll() and returns: the CQE is posted from the
+ * wakeup callback, in whatever context the waker runs, so tracking any
+ * number of fds costs no worker. The CQE's res is the ready POLL* mask.
+ *
+ * A one-shot poll completes on the first wakeup that matches its events.
+ * With XSC_F_MULTISHOT it stays armed and posts a CQE flagged
+ * XSC_CQE_F_MORE on every matching wakeup, i.e. every readiness edge the
+ * file reports, until XSC_OP_POLL_REMOVE or XSC_OP_ASYNC_CANCEL removes
+ * it; the final CQE, -ECANCELED, carries no F_MORE.
+ *
+ * Wakeups without a key (files that do not pass their mask) re-poll the
+ * file from a work item. Unhooking needs the wait queue locks, so it is
+ * deferred to a work item as well; until then a completed poll ignores
+ * further wakeups.
+ *
+ * Multishot RECVFROM rides on the same entries: instead of the
+ * mask, a readiness wakeup queues a work item that runs the op without
+ * blocking (xsc_poll_arm_op()), posting a CQE per result until it gets
+ * -EAGAIN and waits for the next wakeup. Nothing holds a worker, an fd
+ * domain or a cgroup in-flight slot between results. A cancel arriving
+ * while the op runs is posted after the results of that run.
+ */
+
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/file.h>
+#include <linux/refcount.h>
+#include <linux/workqueue.h>
+#include <linux/sched/mm.h>
+
+#include "xsc_internal.h"
+
+/* Most files have one wait queue; pipes and ttys have two */
+#define XSC_POLL_HEADS	2
+
+/* Results an op posts per run before letting other work in */
+#define XSC_POLL_BATCH	32
+
+struct xsc_poll;
+
+struct xsc_poll_entry {
+	struct wait_queue_entry	wait;
+	struct wait_queue_head	*head;		/* NULL once unhooked */
+	struct xsc_poll		*poll;
+};
+
+struct xsc_poll {
+	struct xsc_poll_entry	entry[XSC_POLL_HEADS];
+	int			nr_entries;
+	int			error;		/* from queueing at arm time */
+	struct list_head	node;		/* ctx->polls */
+	struct xsc_ctx		*ctx;
+	struct file		*file;
+	u64			user_data;
+	s32			fd;
+	bool			fixed;
+	u8			opcode;		/* of the CQEs */
+	__poll_t		events;
+	bool			multishot;
+	spinlock_t		lock;		/* orders CQEs against removal */
+	bool			done;		/* final CQE posted */
+	refcount_t		ref;		/* armed + the arming context */
+	struct work_struct	check_work;	/* keyless wakeup */
+	struct work_struct	put_work;	/* drops the armed ref */
+
+	/* Ops driven by readiness (xsc_poll_arm_op()) */
+	int			(*issue)(struct xsc_ctx *ctx,
+					 const struct xsc_sqe *sqe,
+					 struct file *file, u32 *cflags);
+	struct work_struct	issue_work;
+	bool			running;	/* issue_work in an attempt */
+	bool			end_pending;	/* ends once it is out */
+	s32			end_res;
+	struct xsc_sqe		sqe;
+	struct xsc_task_cred	tc;		/* snapshot at arming */
+};
+
+struct xsc_poll_table {
+	poll_table		pt;
+	struct xsc_poll		*poll;
+};
+
+/* Under p->lock. The armed reference goes from process context. */
+static void xsc_poll_finish(struct xsc_poll *p, s32 res, u32 cflags)
+{
+	p->done = true;
+	xsc_post_cqe(p->ctx, p->opcode, p->user_data, res, cflags);
+	queue_work(system_unbound_wq, &p->put_work);
+}
+
+/*
+ * Under p->lock: end the poll with @res, or once the op's attempt in
+ * progress has posted its results. Returns false if it already ended.
+ */
+static bool xsc_poll_end(struct xsc_poll *p, s32 res)
+{
+	if (p->done || p->end_pending)
+		return false;
+	if (p->running) {
+		p->end_pending = true;
+		p->end_res = res;
+	} else {
+		xsc_poll_finish(p, res, 0);
+	}
+	return true;
+}
+
+/* Any context: post for a matching readiness @mask */
+static void xsc_poll_fire(struct xsc_poll *p, __poll_t mask)
+{
+	unsigned long flags;
+
+	if (p->issue) {
+		if (!READ_ONCE(p->done))
+			queue_work(system_unbound_wq, &p->issue_work);
+		return;
+	}
+
+	spin_lock_irqsave(&p->lock, flags);
+	if (!p->done) {
+		if (p->multishot)
+			xsc_post_cqe(p->ctx, XSC_OP_POLL_ADD, p->user_data,
+				     mangle_poll(mask), XSC_CQE_F_MORE);
+		else
+			xsc_poll_finish(p, mangle_poll(mask), 0);
+	}
+	spin_unlock_irqrestore(&p->lock, flags);
+}
+
+/* Called with the wait queue's lock held, possibly from hardirq */
+static int xsc_poll_wake(struct wait_queue_entry *wait, unsigned int mode,
+			 int sync, void *key)
+{
+	struct xsc_poll_entry *e = container_of(wait, struct xsc_poll_entry, wait);
+	struct xsc_poll *p = e->poll;
+	__poll_t mask = key_to_poll(key);
+	unsigned long flags;
+
+	/* The head is about to be freed: let go of it right now */
+	if (unlikely(mask & POLLFREE)) {
+		list_del_init(&wait->entry);
+		smp_store_release(&e->head, NULL);
+		spin_lock_irqsave(&p->lock, flags);
+		xsc_poll_end(p, -ECANCELED);
+		spin_unlock_irqrestore(&p->lock, flags);
+		return 1;
+	}
+
+	if (!mask) {
+		if (!READ_ONCE(p->done))
+			queue_work(system_unbound_wq, &p->check_work);
+		return 0;
+	}
+	if (!(mask & p->events))
+		return 0;
+
+	xsc_poll_fire(p, mask & p->events);
+	return 1;
+}
+
+static void xsc_poll_check(struct work_struct *work)
+{
+	struct xsc_poll *p = container_of(work, struct xsc_poll, check_work);
+	__poll_t mask;
+
+	if (READ_ONCE(p->done))
+		return;
+	mask = vfs_poll(p->file, NULL) & p->events;
+	if (mask)
+		xsc_poll_fire(p, mask);
+}
+
+static void xsc_poll_queue_proc(struct file *file, struct wait_queue_head *head,
+				poll_table *pt)
+{
+	struct xsc_poll_table *xpt = container_of(pt, struct xsc_poll_table, pt);
+	struct xsc_poll *p = xpt->poll;
+	struct xsc_poll_entry *e;
+
+	if (p->nr_entries == XSC_POLL_HEADS) {
+		p->error = -EOPNOTSUPP;
+		return;
+	}
+	e = &p->entry[p->nr_entries++];
+	e->poll = p;
+	e->head = head;
+	init_waitqueue_func_entry(&e->wait, xsc_poll_wake);
+	add_wait_queue(head, &e->wait);
+}
+
+/*
+ * A POLLFREE wakeup may clear e->head and free the head after an RCU
+ * grace period, so the head is only locked under rcu_read_lock().
+ */
+static void xsc_poll_unhook(struct xsc_poll_entry *e)
+{
+	struct wait_queue_head *head;
+
+	rcu_read_lock();
+	head = smp_load_acquire(&e->head);
+	if (head) {
+		spin_lock_irq(&head->lock);
+		list_del_init(&e->wait.entry);
+		e->head = NULL;
+		spin_unlock_irq(&head->lock);
+	}
+	rcu_read_unlock();
+}
+
+/* Process context, never from check_work */
+static void xsc_poll_put(struct xsc_poll *p)
+{
+	struct xsc_ctx *ctx = p->ctx;
+	int i;
+
+	if (!refcount_dec_and_test(&p->ref))
+		return;
+
+	/* No callback runs past this, so neither work is queued again */
+	for (i = 0; i < p->nr_entries; i++)
+		xsc_poll_unhook(&p->entry[i]);
+	cancel_work_sync(&p->check_work);
+	cancel_work_sync(&p->issue_work);
+
+	spin_lock(&ctx->poll_lock);
+	list_del(&p->node);
+	spin_unlock(&ctx->poll_lock);
+	if (p->issue)
+		xsc_task_cred_release(&p->tc);
+	fput(p->file);
+	kfree(p);
+}
+
+static void xsc_poll_put_work(struct work_struct *work)
+{
+	xsc_poll_put(container_of(work, struct xsc_poll, put_work));
+}
+
+/*
+ * One attempt run of an op: until it would block, ends, or has posted
+ * XSC_POLL_BATCH results, after which it queues itself again. Every
+ * result is posted under p->lock, so a cancel's -ECANCELED can only come
+ * after it, never between a filled buffer and its CQE.
+ */
+static void xsc_poll_issue_run(void *arg)
+{
+	struct xsc_poll *p = arg;
+	unsigned long flags;
+	bool more = true;
+	u32 cflags;
+	int i, res;
+
+	for (i = 0; i < XSC_POLL_BATCH && more; i++) {
+		cflags = 0;
+		res = p->issue(p->ctx, &p->sqe, p->file, &cflags);
+		if (res == -EAGAIN)
+			return;
+
+		spin_lock_irqsave(&p->lock, flags);
+		if (cflags & XSC_CQE_F_MORE) {
+			xsc_post_cqe(p->ctx, p->opcode, p->user_data, res,
+				     cflags);
+			more = !p->end_pending;
+		} else {
+			xsc_poll_finish(p, res, cflags);
+			more = false;
+		}
+		spin_unlock_irqrestore(&p->lock, flags);
+		cond_resched();
+	}
+	if (more)
+		queue_work(system_unbound_wq, &p->issue_work);
+}
+
+/* Like a worker, in the owner's mm and charged to it */
+static void xsc_poll_issue(struct work_struct *work)
+{
+	struct xsc_poll *p = container_of(work, struct xsc_poll, issue_work);
+	unsigned long flags;
+	struct mm_struct *mm;
+
+	spin_lock_irqsave(&p->lock, flags);
+	if (p->done || p->end_pending) {
+		spin_unlock_irqrestore(&p->lock, flags);
+		return;
+	}
+	p->running = true;
+	spin_unlock_irqrestore(&p->lock, flags);
+
+	mm = get_task_mm(p->ctx->task);
+	if (mm) {
+		xsc_use_mm(mm);
+		xsc_run_with_attribution(p->ctx, &p->tc, xsc_poll_issue_run, p);
+		xsc_unuse_mm(mm);
+		mmput(mm);
+	}
+
+	spin_lock_irqsave(&p->lock, flags);
+	p->running = false;
+	if (!p->done) {
+		/* The owner is gone: nothing can consume the results */
+		if (!mm)
+			xsc_poll_finish(p, -ECANCELED, 0);
+		else if (p->end_pending)
+			xsc_poll_finish(p, p->end_res, 0);
+	}
+	spin_unlock_irqrestore(&p->lock, flags);
+}
+
+static struct xsc_poll *xsc_poll_alloc(struct xsc_ctx *ctx,
+				       const struct xsc_sqe *sqe,
+				       struct file *file, __poll_t events)
+{
+	struct xsc_poll *p;
+
+	p = kzalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		return NULL;
+	p->ctx = ctx;
+	p->file = file;
+	p->user_data = sqe->user_data;
+	p->fd = sqe->fd;
+	p->fixed = sqe->flags & XSC_F_FIXED_FILE;
+	p->opcode = sqe->opcode;
+	p->events = events | EPOLLERR | EPOLLHUP;
+	p->multishot = sqe->flags & XSC_F_MULTISHOT;
+	spin_lock_init(&p->lock);
+	refcount_set(&p->ref, 2);
+	INIT_WORK(&p->check_work, xsc_poll_check);
+	INIT_WORK(&p->put_work, xsc_poll_put_work);
+	INIT_WORK(&p->issue_work, xsc_poll_issue);
+	return p;
+}
+
+/*
+ * Hook @p onto the file's wait queues and drop the arming reference.
+ * Returns -EIOCBQUEUED once armed, or the result if nothing hooked could
+ * ever wake it.
+ */
+static int xsc_poll_arm(struct xsc_poll *p)
+{
+	struct xsc_ctx *ctx = p->ctx;
+	struct xsc_poll_table xpt;
+	unsigned long flags;
+	__poll_t mask;
+	int ret;
+
+	/* Visible to cancels before any wakeup can complete it */
+	spin_lock(&ctx->poll_lock);
+	list_add_tail(&p->node, &ctx->polls);
+	spin_unlock(&ctx->poll_lock);
+
+	xpt.poll = p;
+	init_poll_funcptr(&xpt.pt, xsc_poll_queue_proc);
+	xpt.pt._key = p->events;
+	mask = vfs_poll(p->file, &xpt.pt) & p->events;
+
+	ret = -EIOCBQUEUED;
+	if (p->error || !p->nr_entries) {
+		/* Complete here; an op could never be retried */
+		spin_lock_irqsave(&p->lock, flags);
+		if (!p->done) {
+			p->done = true;
+			refcount_dec(&p->ref);
+			ret = p->error ?:
+			      p->issue ? -EOPNOTSUPP : mangle_poll(mask);
+		}
+		spin_unlock_irqrestore(&p->lock, flags);
+	} else if (mask) {
+		xsc_poll_fire(p, mask);
+	}
+
+	xsc_poll_put(p);
+	return ret;
+}
+
+/*
+ * xsc_poll_add - XSC_OP_POLL_ADD
+ *
+ * sqe->poll32_events holds the POLL* events of interest (POLLERR and
+ * POLLHUP always count), sqe->len must be 0. Returns
+ * -EIOCBQUEUED once armed: the CQEs come from the wakeups. A file that
+ * is already ready posts at once; one without a wait queue completes
+ * with its current mask.
+ */
+int xsc_poll_add(struct xsc_ctx *ctx, const struct xsc_sqe *sqe)
+{
+	struct xsc_poll *p;
+	struct file *file;
+
+	if (sqe->len)
+		return -EINVAL;
+	/* The chain after a poll would not wait for it */
+	if (sqe->flags & XSC_F_LINK)
+		return -EINVAL;
+
+	file = xsc_get_file(ctx, (struct xsc_sqe *)sqe);
+	if (!file)
+		return -EBADF;
+	/* Our own wakeups would post from under cq_wait's lock */
+	if (file->f_op == ctx->file->f_op) {
+		fput(file);
+		return -EINVAL;
+	}
+
+	p = xsc_poll_alloc(ctx, sqe, file, demangle_poll(sqe->poll32_events));
+	if (!p) {
+		fput(file);
+		return -ENOMEM;
+	}
+	return xsc_poll_arm(p);
+}
+
+/*
+ * xsc_poll_arm_op - Drive a multishot op from readiness of @file
+ * @ctx: ring context
+ * @sqe: the op, copied
+ * @file: referenced file the op works on; the poll owns it from here
+ * @events: readiness that may let the op make progress
+ * @issue: one non-blocking attempt of the op
+ *
+ * @issue returns -EAGAIN to wait for the next wakeup; any other result
+ * is posted with the flags it sets in *cflags, and ends the op unless
+ * they include XSC_CQE_F_MORE. It runs from a work item in the owner's
+ * mm, attributed like a worker. Returns -EIOCBQUEUED once armed.
+ */
+int xsc_poll_arm_op(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+		    struct file *file, __poll_t events,
+		    int (*issue)(struct xsc_ctx *, const struct xsc_sqe *,
+				 struct file *, u32 *))
+{
+	struct xsc_poll *p;
+
+	p = xsc_poll_alloc(ctx, sqe, file, events);
+	if (!p) {
+		fput(file);
+		return -ENOMEM;
+	}
+	p->issue = issue;
+	p->sqe = *sqe;
+	xsc_task_cred_snapshot(&p->tc, ctx->task);
+	return xsc_poll_arm(p);
+}
+
+static int __xsc_poll_cancel(struct xsc_ctx *ctx, u64 user_data, s32 fd,
+			     bool fixed, u32 cancel_flags, bool polls_only)
+{
+	unsigned long flags;
+	struct xsc_poll *p;
+	int nr = 0;
+
+	spin_lock(&ctx->poll_lock);
+	list_for_each_entry(p, &ctx->polls, node) {
+		if (polls_only && p->issue)
+			continue;
+		if (!(cancel_flags & XSC_CANCEL_ANY) &&
+		    (cancel_flags & XSC_CANCEL_FD ?
+		     p->fd != fd || p->fixed != fixed :
+		     p->user_data != user_data))
+			continue;
+
+		spin_lock_irqsave(&p->lock, flags);
+		if (xsc_poll_end(p, -ECANCELED))
+			nr++;
+		spin_unlock_irqrestore(&p->lock, flags);
+		if (nr && !(cancel_flags & XSC_CANCEL_ALL))
+			break;
+	}
+	spin_unlock(&ctx->poll_lock);
+	return nr;
+}
+
+/*
+ * xsc_poll_cancel - Remove armed polls and ops matching a cancel
+ *
+ * Each posts its final -ECANCELED here, or an op once its attempt in
+ * progress is done; unhooking follows from a work item. Returns the
+ * number cancelled.
+ */
+int xsc_poll_cancel(struct xsc_ctx *ctx, u64 user_data, s32 fd, bool fixed,
+		    u32 cancel_flags)
+{
+	return __xsc_poll_cancel(ctx, user_data, fd, fixed, cancel_flags,
+				 false);
+}
+
+/*
+ * xsc_poll_remove - XSC_OP_POLL_REMOVE
+ *
+ * Removes the poll whose user_data is sqe->addr; -ENOENT if none is
+ * armed (a one-shot poll that already fired included). Multishot ops
+ * are not polls: XSC_OP_ASYNC_CANCEL removes them.
+ */
+int xsc_poll_remove(struct xsc_ctx *ctx, const struct xsc_sqe *sqe)
+{
+	if (sqe->len || sqe->poll32_events)
+		return -EINVAL;
+	return __xsc_poll_cancel(ctx, sqe->addr, 0, false, 0, true) ?
+	       0 : -ENOENT;
+}
+
+/*
+ * xsc_poll_release - Cancel every poll and wait until all are unhooked
+ *
+ * Called once nothing can arm a poll any more.
+ */
+void xsc_poll_release(struct xsc_ctx *ctx)
+{
+	bool empty;
+
+	for (;;) {
+		xsc_poll_cancel(ctx, 0, 0, false,
+				XSC_CANCEL_ANY | XSC_CANCEL_ALL);
+		spin_lock(&ctx->poll_lock);
+		empty = list_empty(&ctx->polls);
+		spin_unlock(&ctx->poll_lock);
+		if (empty)
+			break;
+		usleep_range(100, 200);
+	}
+}
@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC fixed files and per-ring restrictions
+ * Copyright (C) 2025
+ *
+ * Fixed files let a ring reference pre-resolved struct file pointers by
+ * slot. Restrictions lock a ring to a registered set of opcodes, SQE
+ * flags and fixed-file slots; they are checked with bit tests when the
+ * worker dequeues an SQE, similar in spirit to io_uring restrictions.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/bitmap.h>
+
+#include "xsc_internal.h"
+
+/*
+ * xsc_register_files - Install or update fixed-file slots
+ * @ctx: ring context
+ * @arg: user pointer to struct xsc_files_update
+ *
+ * The first call allocates the whole table, XSC_MAX_FIXED_FILES slots;
+ * any call may then update any range of it. An fd of -1 clears a slot.
+ * files_lock keeps an unregister from pulling the table out from under
+ * the stores. The slots are part of what restrictions vet, so they are
+ * frozen once restrictions are registered: -EACCES.
+ */
+int xsc_register_files(struct xsc_ctx *ctx, void __user *arg)
+{
+	struct xsc_files_update up;
+	s32 __user *fds;
+	struct file **table;
+	int ret = 0;
+	u32 i;
+
+	if (copy_from_user(&up, arg, sizeof(up)))
+		return -EFAULT;
+	if (!up.nr || up.nr > XSC_MAX_FIXED_FILES ||
+	    up.offset > XSC_MAX_FIXED_FILES - up.nr)
+		return -EINVAL;
+
+	fds = u64_to_user_ptr(up.fds);
+
+	mutex_lock(&ctx->files_lock);
+	if (ctx->restricted) {
+		ret = -EACCES;
+		goto out;
+	}
+	if (!ctx->fixed_files) {
+		table = kvcalloc(XSC_MAX_FIXED_FILES, sizeof(*table),
+				 GFP_KERNEL_ACCOUNT);
+		if (!table) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		/* Lookups see a zeroed table or none */
+		smp_store_release(&ctx->fixed_files, table);
+	}
+
+	for (i = 0; i < up.nr; i++) {
+		struct file *file = NULL, *old;
+		s32 fd;
+
+		if (get_user(fd, &fds[i])) {
+			ret = -EFAULT;
+			break;
+		}
+		if (fd != -1) {
+			file = fget(fd);
+			if (!file) {
+				ret = -EBADF;
+				break;
+			}
+			/*
+			 * A ring, this one or another, holding a slot could
+			 * close a reference cycle and pin both forever
+			 */
+			if (file->f_op == ctx->file->f_op) {
+				fput(file);
+				ret = -EBADF;
+				break;
+			}
+		}
+
+		old = ctx->fixed_files[up.offset + i];
+		WRITE_ONCE(ctx->fixed_files[up.offset + i], file);
+
+		if (old)
+			fput(old);
+	}
+out:
+	mutex_unlock(&ctx->files_lock);
+	return ret;
+}
+
+static void xsc_put_files(struct file **table)
+{
+	u32 i;
+
+	if (!table)
+		return;
+	for (i = 0; i < XSC_MAX_FIXED_FILES; i++)
+		if (table[i])
+			fput(table[i]);
+	kvfree(table);
+}
+
+/* XSC_IOC_UNREGISTER_FILES; -EACCES once restrictions are registered */
+int xsc_unregister_files(struct xsc_ctx *ctx)
+{
+	struct file **table = NULL;
+	int ret = 0;
+
+	mutex_lock(&ctx->files_lock);
+	if (ctx->restricted) {
+		ret = -EACCES;
+	} else {
+		table = ctx->fixed_files;
+		WRITE_ONCE(ctx->fixed_files, NULL);
+	}
+	mutex_unlock(&ctx->files_lock);
+
+	/* Lookups may still be reading the table */
+	if (table)
+		synchronize_rcu();
+	xsc_put_files(table);
+	return ret;
+}
+
+/* Ring release: nothing can look a slot up any more */
+void xsc_free_files(struct xsc_ctx *ctx)
+{
+	xsc_put_files(ctx->fixed_files);
+	ctx->fixed_files = NULL;
+}
+
+/*
+ * xsc_get_file - Resolve the file an SQE refers to
+ *
+ * Honours XSC_F_FIXED_FILE, otherwise looks sqe->fd up in the owner's
+ * file table. Returns a referenced file or NULL.
+ *
+ * Fixed slots are read locklessly, the way fget() reads an fdtable: the
+ * table is freed after a grace period, a file being released fails
+ * get_file_rcu(), and a slot updated under us is read again.
+ */
+static struct file *__xsc_get_file(struct xsc_ctx *ctx, s32 fd, bool fixed)
+{
+	struct file *file = NULL;
+
+	if (fixed) {
+		struct file **table;
+
+		if ((u32)fd >= XSC_MAX_FIXED_FILES)
+			return NULL;
+		rcu_read_lock();
+		table = smp_load_acquire(&ctx->fixed_files);
+		while (table && (file = READ_ONCE(table[fd]))) {
+			if (!get_file_rcu(file))
+				continue;
+			if (likely(file == READ_ONCE(table[fd])))
+				break;
+			fput(file);
+		}
+		rcu_read_unlock();
+		return file;
+	}
+
+	rcu_read_lock();
+	file = files_lookup_fd_rcu(ctx->files, fd);
+	if (file && !get_file_rcu(file))
+		file = NULL;
+	rcu_read_unlock();
+
+	return file;
+}
+
+struct file *xsc_get_file(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	return __xsc_get_file(ctx, sqe->fd, sqe->flags & XSC_F_FIXED_FILE);
+}
+
+/*
+ * xsc_get_file_in - Resolve a splice source, sqe->splice_fd_in
+ *
+ * XSC_SPLICE_F_FD_IN_FIXED makes it a fixed slot, which restrictions
+ * must allow just like a fixed sqe->fd. Returns a referenced file or
+ * an ERR_PTR.
+ */
+struct file *xsc_get_file_in(struct xsc_ctx *ctx, struct xsc_sqe *sqe)
+{
+	bool fixed = sqe->splice_flags & XSC_SPLICE_F_FD_IN_FIXED;
+	const struct xsc_restrict *r = &ctx->restrictions;
+	s32 fd = sqe->splice_fd_in;
+	struct file *file;
+
+	if (fixed && smp_load_acquire(&ctx->restricted) && r->nr_file_slots &&
+	    ((u32)fd >= r->nr_file_slots || !test_bit(fd, r->file_slots)))
+		return ERR_PTR(-EACCES);
+
+	file = __xsc_get_file(ctx, fd, fixed);
+	return file ?: ERR_PTR(-EBADF);
+}
+
+/*
+ * xsc_register_restrictions - Lock the ring to an allowed SQE set
+ * @ctx: ring context
+ * @arg: user pointer to struct xsc_restrictions
+ *
+ * One-shot and irreversible: a second registration fails with -EBUSY.
+ * From then on the fixed-file table can no longer be changed.
+ */
+int xsc_register_restrictions(struct xsc_ctx *ctx, void __user *arg)
+{
+	struct xsc_restrict *r = &ctx->restrictions;
+	struct xsc_restrictions ureg;
+	unsigned long *slots = NULL;
+	int ret = 0;
+
+	if (copy_from_user(&ureg, arg, sizeof(ureg)))
+		return -EFAULT;
+	if (ureg.resv || ureg.resv2[0] || ureg.resv2[1])
+		return -EINVAL;
+	if (ureg.sqe_flags_required & ~ureg.sqe_flags_allowed)
+		return -EINVAL;
+	if (ureg.nr_file_slots > XSC_MAX_FIXED_FILES)
+		return -EINVAL;
+
+	if (ureg.nr_file_slots) {
+		u64 *words;
+
+		words = memdup_user(u64_to_user_ptr(ureg.file_slots),
+				    BITS_TO_U64(ureg.nr_file_slots) * sizeof(u64));
+		if (IS_ERR(words))
+			return PTR_ERR(words);
+
+		slots = bitmap_zalloc(ureg.nr_file_slots, GFP_KERNEL);
+		if (!slots) {
+			kfree(words);
+			return -ENOMEM;
+		}
+		bitmap_from_arr64(slots, words, ureg.nr_file_slots);
+		kfree(words);
+	}
+
+	/* Ordered against fixed-file updates, which it freezes */
+	mutex_lock(&ctx->files_lock);
+	spin_lock(&ctx->lock);
+	if (ctx->restricted) {
+		ret = -EBUSY;
+	} else {
+		bitmap_from_arr64(r->sqe_op, ureg.sqe_op, XSC_RESTRICT_OPS);
+		r->sqe_flags_allowed = ureg.sqe_flags_allowed;
+		r->sqe_flags_required = ureg.sqe_flags_required;
+		r->nr_file_slots = ureg.nr_file_slots;
+		r->file_slots = slots;
+		slots = NULL;
+		/* Publish only after the bitmaps are complete */
+		smp_store_release(&ctx->restricted, true);
+	}
+	spin_unlock(&ctx->lock);
+	mutex_unlock(&ctx->files_lock);
+
+	bitmap_free(slots);
+	return ret;
+}
+
+void xsc_free_restrictions(struct xsc_ctx *ctx)
+{
+	bitmap_free(ctx->restrictions.file_slots);
+	ctx->restrictions.file_slots = NULL;
+}
@@ -0,0 +1,1001 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC request scheduling
+ * Copyright (C) 2025
+ *
+ * The SQ feeder (xsc_sq_worker) copies each SQE into an xsc_req and hands
+ * it here. Requests are keyed by fd into per-ring ordering domains and
+ * sorted by ioprio class (RT, best-effort, idle) into ready queues; a
+ * ring's max_workers worker slots always take the highest-class ready
+ * request, so a latency-critical op overtakes queued bulk ops on other
+ * fds. Ordering rules:
+ *
+ *   - ops on the same fd run in submission order, whatever their class;
+ *   - ops that name no fd have no ordering constraint;
+ *   - an XSC_F_LINK chain runs as one unit at its head's class, and a
+ *     failing member cancels the rest with -ECANCELED;
+ *   - an XSC_F_DRAIN op (chain head) starts only once everything before
+ *     it has completed, and nothing after it starts until it completes.
+ *
+ * Within a class, ready chains whose head carries an XSC_F_DEADLINE run
+ * earliest deadline first, ahead of those without one. A chain head's
+ * deadline is also armed on the timer wheel: if it passes while the
+ * chain is still queued, the chain is unlinked and completed with
+ * -ETIME (members -ECANCELED) without waiting for a worker. Any op
+ * found past its deadline at dequeue gets -ETIME without running.
+ *
+ * XSC_OP_ASYNC_CANCEL takes matching chains off the queues, or interrupts
+ * the op a worker is running; see xsc_sched_do_cancel().
+ *
+ * Routing a chain also takes an in-flight slot of the ring owner's cgroup
+ * (xsc_fair.c); when the cgroup is at its limit the ring's deferred list
+ * waits, and a worker slot yields after a weighted quantum of chains.
+ *
+ * Each ring also has an execution mode, re-evaluated every
+ * XSC_EXEC_WINDOW_NS from its submission rate and worker utilization:
+ *
+ *   inline  - the submitter runs its SQEs in xsc_write(): no wakeup, no
+ *             cross-core traffic. Left once the rate passes inline_qps.
+ *   sibling - workers on the submitter's SMT siblings, sharing its caches.
+ *             Left for remote once workers are busy remote_util_pct of
+ *             the time, or for inline below half of inline_qps.
+ *   remote  - workers on other cores (the syscall cores, if dedicated).
+ *             Back to sibling below half of remote_util_pct.
+ *
+ * A switch needs XSC_EXEC_VOTES windows in a row agreeing, on top of the
+ * threshold gaps, so a ring does not flap around a boundary.
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/workqueue.h>
+#include <linux/ioprio.h>
+#include <linux/rbtree.h>
+#include <linux/timer.h>
+
+#include "xsc_internal.h"
+
+static unsigned int max_workers = 4;
+module_param(max_workers, uint, 0644);
+MODULE_PARM_DESC(max_workers,
+		 "Concurrent workers per ring unless set at XSC_IOC_SETUP");
+
+static bool exec_auto = true;
+module_param(exec_auto, bool, 0644);
+MODULE_PARM_DESC(exec_auto,
+		 "Pick inline/sibling/remote execution per ring from load");
+
+static unsigned int inline_qps = 20000;
+module_param(inline_qps, uint, 0644);
+MODULE_PARM_DESC(inline_qps,
+		 "SQEs/s above which a ring stops executing inline");
+
+static unsigned int remote_util_pct = 70;
+module_param(remote_util_pct, uint, 0644);
+MODULE_PARM_DESC(remote_util_pct,
+		 "Worker utilization (%) above which a ring moves to remote cores");
+
+#define XSC_EXEC_WINDOW_NS	(10 * NSEC_PER_MSEC)
+#define XSC_EXEC_VOTES		3
+
+static const char * const xsc_exec_names[] = {
+	[XSC_EXEC_INLINE]	= "inline",
+	[XSC_EXEC_SIBLING]	= "sibling",
+	[XSC_EXEC_REMOTE]	= "remote",
+};
+
+static struct kmem_cache *xsc_req_cachep;
+
+/* Ops that do not name an fd have no ordering constraint */
+static bool xsc_op_is_fdless(u8 opcode)
+{
+	switch (opcode) {
+	case XSC_OP_NOP:
+	case XSC_OP_OPEN:
+	case XSC_OP_STAT:
+	case XSC_OP_LSTAT:
+	case XSC_OP_SOCKET:
+	case XSC_OP_POLL:
+	case XSC_OP_SELECT:
+	case XSC_OP_NANOSLEEP:
+	case XSC_OP_CLOCK_NANOSLEEP:
+	case XSC_OP_FUTEX_WAIT:
+	case XSC_OP_FUTEX_WAKE:
+	case XSC_OP_FORK:
+	case XSC_OP_VFORK:
+	case XSC_OP_CLONE:
+	case XSC_OP_EXECVE:
+	case XSC_OP_EXECVEAT:
+	case XSC_OP_ASYNC_CANCEL:
+	case XSC_OP_TIMEOUT:
+	case XSC_OP_POLL_REMOVE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool xsc_op_is_immediate(u8 opcode)
+{
+	switch (opcode) {
+	case XSC_OP_ASYNC_CANCEL:
+	case XSC_OP_TIMEOUT:
+	case XSC_OP_POLL_ADD:
+	case XSC_OP_POLL_REMOVE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Domain key of an SQE, false if it has no ordering constraint */
+static bool xsc_sqe_domain_key(const struct xsc_sqe *sqe, u32 *key)
+{
+	if (xsc_op_is_fdless(sqe->opcode) || sqe->fd < 0)
+		return false;
+
+	/* Fixed-file slots and real fds are separate namespaces */
+	*key = (u32)sqe->fd;
+	if (sqe->flags & XSC_F_FIXED_FILE)
+		*key |= BIT(31);
+	return true;
+}
+
+/*
+ * Find or create the domain of @key and take a reference for a chain.
+ * Called with sched_lock held; a new domain comes from domain_spare,
+ * which the feeder fills beforehand.
+ */
+static struct xsc_domain *xsc_domain_get(struct xsc_ctx *ctx, u32 key)
+{
+	struct hlist_head *head = &ctx->domains[hash_32(key, XSC_DOMAIN_BITS)];
+	struct xsc_domain *d;
+
+	hlist_for_each_entry(d, head, node) {
+		if (d->key == key) {
+			d->refs++;
+			return d;
+		}
+	}
+
+	d = ctx->domain_spare;
+	ctx->domain_spare = NULL;
+	d->key = key;
+	d->refs = 1;
+	d->busy = false;
+	INIT_LIST_HEAD(&d->reqs);
+	hlist_add_head(&d->node, head);
+	return d;
+}
+
+/* A chain let go of its domain. Called with sched_lock held. */
+static void xsc_domain_put(struct xsc_domain *d)
+{
+	if (d && !--d->refs) {
+		hlist_del(&d->node);
+		kfree(d);
+	}
+}
+
+static u8 xsc_req_class(const struct xsc_sqe *sqe)
+{
+	switch (IOPRIO_PRIO_CLASS(sqe->ioprio)) {
+	case IOPRIO_CLASS_RT:
+		return XSC_CLASS_RT;
+	case IOPRIO_CLASS_IDLE:
+		return XSC_CLASS_IDLE;
+	default:
+		return XSC_CLASS_BE;
+	}
+}
+
+static bool xsc_req_dl_less(struct rb_node *a, const struct rb_node *b)
+{
+	return rb_entry(a, struct xsc_req, run_rb)->deadline_ns <
+	       rb_entry(b, struct xsc_req, run_rb)->deadline_ns;
+}
+
+/* Queue a request as ready and make sure a worker slot will take it */
+static void xsc_sched_ready(struct xsc_ctx *ctx, struct xsc_req *req)
+{
+	struct xsc_worker *w;
+	u32 i;
+
+	req->state = XSC_REQ_READY;
+	if (req->deadline_ns)
+		rb_add_cached(&req->run_rb, &ctx->dl_runq[req->class],
+			      xsc_req_dl_less);
+	else
+		list_add_tail(&req->run_node, &ctx->runq[req->class]);
+
+	for (i = 0; i < ctx->nr_workers; i++) {
+		w = &ctx->workers[i];
+		if (!w->active) {
+			w->active = true;
+			queue_work(ctx->wq, &w->work);
+			return;
+		}
+	}
+	/* All slots active: each re-checks the ready queues before idling */
+}
+
+static void xsc_sched_unready(struct xsc_ctx *ctx, struct xsc_req *req)
+{
+	if (req->deadline_ns)
+		rb_erase_cached(&req->run_rb, &ctx->dl_runq[req->class]);
+	else
+		list_del(&req->run_node);
+}
+
+static struct xsc_req *xsc_sched_pop(struct xsc_ctx *ctx)
+{
+	struct rb_node *rb;
+	struct xsc_req *req;
+	int c;
+
+	for (c = 0; c < XSC_NR_CLASSES; c++) {
+		rb = rb_first_cached(&ctx->dl_runq[c]);
+		if (rb)
+			req = rb_entry(rb, struct xsc_req, run_rb);
+		else
+			req = list_first_entry_or_null(&ctx->runq[c],
+						       struct xsc_req, run_node);
+		if (req) {
+			xsc_sched_unready(ctx, req);
+			req->state = XSC_REQ_RUNNING;
+			return req;
+		}
+	}
+	return NULL;
+}
+
+static void xsc_sched_route(struct xsc_ctx *ctx, struct xsc_req *req)
+{
+	struct xsc_domain *d = req->domain;
+
+	if (d && d->busy) {
+		req->state = XSC_REQ_WAITING;
+		list_add_tail(&req->node, &d->reqs);
+		return;
+	}
+	if (d)
+		d->busy = true;
+	xsc_sched_ready(ctx, req);
+}
+
+/*
+ * Route deferred requests, stopping at a drain barrier.
+ * Called with sched_lock held.
+ */
+static void xsc_sched_run_deferred(struct xsc_ctx *ctx)
+{
+	struct xsc_req *req;
+	bool drain;
+
+	lockdep_assert_held(&ctx->sched_lock);
+
+	while ((req = list_first_entry_or_null(&ctx->deferred,
+					       struct xsc_req, node))) {
+		if (ctx->drain_running)
+			break;
+		drain = req->sqe.flags & XSC_F_DRAIN;
+		if (drain && ctx->inflight)
+			break;
+		if (!xsc_fair_get(ctx))
+			break;
+		if (drain)
+			ctx->drain_running = true;
+
+		list_del(&req->node);
+		ctx->inflight++;
+		xsc_sched_route(ctx, req);
+	}
+}
+
+/*
+ * A routed chain is gone: hand its domain to the next waiter and route
+ * anything it held back. Called with sched_lock held.
+ */
+static void xsc_sched_retire(struct xsc_ctx *ctx, struct xsc_domain *d,
+			     bool drain)
+{
+	struct xsc_req *next;
+
+	if (d) {
+		next = list_first_entry_or_null(&d->reqs, struct xsc_req, node);
+		if (next) {
+			list_del(&next->node);
+			xsc_sched_ready(ctx, next);
+		} else {
+			d->busy = false;
+		}
+		xsc_domain_put(d);
+	}
+
+	ctx->inflight--;
+	xsc_fair_put(ctx);
+	if (drain)
+		ctx->drain_running = false;
+	xsc_sched_run_deferred(ctx);
+}
+
+static void xsc_free_chain(struct xsc_req *req)
+{
+	struct xsc_req *next;
+
+	for (; req; req = next) {
+		next = req->link;
+		kmem_cache_free(xsc_req_cachep, req);
+	}
+}
+
+/* Complete a chain that never ran: @res for its head, -ECANCELED after */
+static void xsc_fail_chain(struct xsc_ctx *ctx, struct xsc_req *req, int res)
+{
+	struct xsc_req *next;
+
+	for (; req; req = next) {
+		next = req->link;
+		xsc_complete_cqe(ctx, req->sqe.opcode, req->sqe.user_data, res);
+		kmem_cache_free(xsc_req_cachep, req);
+		res = -ECANCELED;
+	}
+}
+
+/*
+ * Take a queued chain head off its queue. Its routing is dropped by
+ * xsc_sched_unroute(). Called with sched_lock held.
+ */
+static void xsc_sched_detach(struct xsc_ctx *ctx, struct xsc_req *req)
+{
+	switch (req->state) {
+	case XSC_REQ_DEFERRED:
+	case XSC_REQ_WAITING:
+		list_del(&req->node);
+		break;
+	case XSC_REQ_READY:
+		xsc_sched_unready(ctx, req);
+		break;
+	}
+}
+
+/*
+ * Give back what a detached chain held: its domain reference, its
+ * in-flight slot and, once ready, the domain itself. It is then owned by
+ * the caller (XSC_REQ_RUNNING), which an expiry timer racing with it
+ * leaves alone.
+ */
+static void xsc_sched_unroute(struct xsc_ctx *ctx, struct xsc_req *req)
+{
+	bool drain = req->sqe.flags & XSC_F_DRAIN;
+
+	switch (req->state) {
+	case XSC_REQ_DEFERRED:
+		xsc_domain_put(req->domain);
+		break;
+	case XSC_REQ_WAITING:
+		xsc_domain_put(req->domain);
+		ctx->inflight--;
+		xsc_fair_put(ctx);
+		if (drain)
+			ctx->drain_running = false;
+		break;
+	case XSC_REQ_READY:
+		xsc_sched_retire(ctx, req->domain, drain);
+		break;
+	}
+	req->state = XSC_REQ_RUNNING;
+}
+
+/* A chain finished: release its domain and anything it held back */
+static void xsc_sched_done(struct xsc_ctx *ctx, struct xsc_req *head)
+{
+	spin_lock_bh(&ctx->sched_lock);
+	list_del(&head->node);
+	/* A cancel that raced with the last op must not leak into the next */
+	clear_notify_signal();
+	xsc_sched_retire(ctx, head->domain, head->sqe.flags & XSC_F_DRAIN);
+	spin_unlock_bh(&ctx->sched_lock);
+}
+
+static void xsc_run_chain(struct xsc_ctx *ctx, struct xsc_req *head)
+{
+	struct xsc_req *req, *lt;
+	int ret = 0;
+
+	for (req = head; req; req = req->link) {
+		if (ret < 0) {
+			xsc_complete_cqe(ctx, req->sqe.opcode,
+					 req->sqe.user_data, -ECANCELED);
+			continue;
+		}
+		if (req != head) {
+			/* Cancellation targets the member being issued */
+			spin_lock_bh(&ctx->sched_lock);
+			head->cur = req;
+			clear_notify_signal();
+			spin_unlock_bh(&ctx->sched_lock);
+		}
+
+		/* An XSC_OP_LINK_TIMEOUT right after bounds this op alone */
+		lt = req->link;
+		if (!lt || lt->sqe.opcode != XSC_OP_LINK_TIMEOUT) {
+			ret = xsc_issue_req(ctx, req);
+			continue;
+		}
+
+		ret = xsc_ltimeout_arm(ctx, lt, req);
+		if (ret) {
+			xsc_complete_cqe(ctx, req->sqe.opcode,
+					 req->sqe.user_data, -ECANCELED);
+			xsc_complete_cqe(ctx, lt->sqe.opcode, lt->sqe.user_data,
+					 ret);
+		} else {
+			ret = xsc_issue_req(ctx, req);
+			xsc_complete_cqe(ctx, lt->sqe.opcode, lt->sqe.user_data,
+					 xsc_ltimeout_disarm(lt) ? -ETIME :
+								  -ECANCELED);
+		}
+		req = lt;
+	}
+}
+
+/*
+ * A chain head's deadline passed while it was still queued. Runs from
+ * the timer softirq, hence sched_lock is always taken with BHs off.
+ */
+static void xsc_req_expire(struct timer_list *t)
+{
+	struct xsc_req *req = from_timer(req, t, expire);
+	struct xsc_ctx *ctx = req->ctx;
+
+	spin_lock(&ctx->sched_lock);
+	if (req->state == XSC_REQ_RUNNING || ctx->sched_dying) {
+		/* A worker, a cancel or xsc_sched_release() owns it */
+		spin_unlock(&ctx->sched_lock);
+		return;
+	}
+	xsc_sched_detach(ctx, req);
+	xsc_sched_unroute(ctx, req);
+	xsc_sched_run_deferred(ctx);
+	spin_unlock(&ctx->sched_lock);
+
+	xsc_fail_chain(ctx, req, -ETIME);
+}
+
+static void xsc_worker_fn(struct work_struct *work)
+{
+	struct xsc_worker *w = container_of(work, struct xsc_worker, work);
+	struct xsc_ctx *ctx = w->ctx;
+	struct xsc_req *req;
+	u32 quantum = xsc_fair_quantum(ctx);
+
+	for (;;) {
+		spin_lock_bh(&ctx->sched_lock);
+		req = xsc_sched_pop(ctx);
+		if (req) {
+			req->task = current;
+			req->cur = req;
+			list_add_tail(&req->node, &ctx->running);
+		} else {
+			w->active = false;
+		}
+		spin_unlock_bh(&ctx->sched_lock);
+		if (!req)
+			break;
+
+		/* RUNNING now; wait out an expiry that raced with the pop */
+		if (req->deadline_ns)
+			del_timer_sync(&req->expire);
+
+		if (ctx->task)
+			xsc_sched_inherit(w, ctx->task);
+		xsc_run_chain(ctx, req);
+		xsc_sched_done(ctx, req);
+		xsc_free_chain(req);
+
+		/* Turn over: stay active, but behind other rings' work */
+		if (!--quantum) {
+			queue_work(ctx->wq, &w->work);
+			break;
+		}
+	}
+
+	/* The kworker goes back to the pool with its own attributes */
+	xsc_sched_restore(w);
+}
+
+struct xsc_cancel_cd {
+	u64	data;
+	s32	fd;
+	u32	flags;		/* XSC_CANCEL_* */
+	bool	fixed;
+	int	nr;
+};
+
+static bool xsc_cancel_match(const struct xsc_req *req,
+			     struct xsc_cancel_cd *cd)
+{
+	const struct xsc_sqe *sqe = &req->sqe;
+
+	/* Timeouts go with the op they bound */
+	if (req->cancelled || sqe->opcode == XSC_OP_ASYNC_CANCEL ||
+	    sqe->opcode == XSC_OP_LINK_TIMEOUT)
+		return false;
+	if (!(cd->flags & XSC_CANCEL_ALL) && cd->nr)
+		return false;
+	if (cd->flags & XSC_CANCEL_ANY)
+		return true;
+	if (cd->flags & XSC_CANCEL_FD)
+		return !xsc_op_is_fdless(sqe->opcode) && sqe->fd == cd->fd &&
+		       !!(sqe->flags & XSC_F_FIXED_FILE) == cd->fixed;
+	return sqe->user_data == cd->data;
+}
+
+/*
+ * Mark matching members of a chain from @req on; they complete with
+ * -ECANCELED when their turn comes, and so does the rest of the chain.
+ */
+static void xsc_cancel_members(struct xsc_req *req, struct xsc_cancel_cd *cd)
+{
+	for (; req; req = req->link) {
+		if (xsc_cancel_match(req, cd)) {
+			req->cancelled = true;
+			cd->nr++;
+		}
+	}
+}
+
+/* Queued chain head: detach it onto @out if it matches */
+static void xsc_cancel_queued(struct xsc_req *req, struct xsc_cancel_cd *cd,
+			      struct xsc_ctx *ctx, struct list_head *out)
+{
+	if (!xsc_cancel_match(req, cd)) {
+		xsc_cancel_members(req->link, cd);
+		return;
+	}
+	req->cancelled = true;
+	cd->nr++;
+	xsc_sched_detach(ctx, req);
+	list_add_tail(&req->node, out);
+}
+
+/*
+ * Cancel matching ops. Queued chains are taken off their queues and
+ * complete with -ECANCELED; an op already running is interrupted with
+ * TIF_NOTIFY_SIGNAL, which breaks interruptible sleeps (futex waits,
+ * accept, sleeps) as a signal would, and xsc_issue_req() turns the
+ * resulting -EINTR/-ERESTART* into -ECANCELED. Returns the number of
+ * ops cancelled.
+ */
+static int xsc_sched_do_cancel(struct xsc_ctx *ctx, struct xsc_cancel_cd *cd)
+{
+	struct xsc_req *req, *tmp;
+	struct xsc_domain *d;
+	struct rb_node *rb, *next;
+	LIST_HEAD(out);
+	int i;
+
+	spin_lock_bh(&ctx->sched_lock);
+	list_for_each_entry(req, &ctx->running, node) {
+		if (xsc_cancel_match(req->cur, cd)) {
+			req->cur->cancelled = true;
+			cd->nr++;
+			set_notify_signal(req->task);
+		}
+		xsc_cancel_members(req->cur->link, cd);
+	}
+
+	for (i = 0; i < XSC_NR_CLASSES; i++) {
+		for (rb = rb_first_cached(&ctx->dl_runq[i]); rb; rb = next) {
+			next = rb_next(rb);
+			xsc_cancel_queued(rb_entry(rb, struct xsc_req, run_rb),
+					  cd, ctx, &out);
+		}
+		list_for_each_entry_safe(req, tmp, &ctx->runq[i], run_node)
+			xsc_cancel_queued(req, cd, ctx, &out);
+	}
+	for (i = 0; i < XSC_NR_DOMAINS; i++)
+		hlist_for_each_entry(d, &ctx->domains[i], node)
+			list_for_each_entry_safe(req, tmp, &d->reqs, node)
+				xsc_cancel_queued(req, cd, ctx, &out);
+	list_for_each_entry_safe(req, tmp, &ctx->deferred, node)
+		xsc_cancel_queued(req, cd, ctx, &out);
+
+	/* Routing is given back once nothing is being walked any more */
+	list_for_each_entry(req, &out, node)
+		xsc_sched_unroute(ctx, req);
+	xsc_sched_run_deferred(ctx);
+	spin_unlock_bh(&ctx->sched_lock);
+
+	list_for_each_entry_safe(req, tmp, &out, node) {
+		if (req->deadline_ns)
+			del_timer_sync(&req->expire);
+		xsc_fail_chain(ctx, req, -ECANCELED);
+	}
+
+	/* Armed XSC_OP_TIMEOUTs and POLL_ADDs are no longer on any queue */
+	if (cd->flags & XSC_CANCEL_ALL || !cd->nr)
+		cd->nr += xsc_timeout_cancel(ctx, cd->data, cd->flags);
+	if (cd->flags & XSC_CANCEL_ALL || !cd->nr)
+		cd->nr += xsc_poll_cancel(ctx, cd->data, cd->fd, cd->fixed,
+					  cd->flags);
+	return cd->nr;
+}
+
+/*
+ * xsc_sched_cancel - XSC_OP_ASYNC_CANCEL
+ *
+ * Matches sqe->addr against user_data, or with XSC_CANCEL_FD sqe->fd
+ * (XSC_F_FIXED_FILE picks the namespace), or with XSC_CANCEL_ANY
+ * everything. Returns the number cancelled with XSC_CANCEL_ALL, else 0;
+ * -ENOENT if nothing matched.
+ */
+int xsc_sched_cancel(struct xsc_ctx *ctx, const struct xsc_sqe *sqe)
+{
+	struct xsc_cancel_cd cd = {
+		.data	= sqe->addr,
+		.fd	= sqe->fd,
+		.flags	= sqe->cancel_flags,
+		.fixed	= sqe->flags & XSC_F_FIXED_FILE,
+	};
+	int nr;
+
+	if (cd.flags & ~(XSC_CANCEL_ALL | XSC_CANCEL_FD | XSC_CANCEL_ANY))
+		return -EINVAL;
+
+	nr = xsc_sched_do_cancel(ctx, &cd);
+	if (!nr)
+		return -ENOENT;
+	return cd.flags & XSC_CANCEL_ALL ? nr : 0;
+}
+
+/*
+ * xsc_cancel_pending_sqes - Cancel everything a ring has queued or running
+ *
+ * v8-D §8.4: on close (task exit, exec, explicit close), so the release
+ * path does not wait for ops that may never finish.
+ */
+void xsc_cancel_pending_sqes(struct xsc_ctx *ctx)
+{
+	struct xsc_cancel_cd cd = {
+		.flags	= XSC_CANCEL_ANY | XSC_CANCEL_ALL,
+	};
+
+	if (ctx->domains)
+		xsc_sched_do_cancel(ctx, &cd);
+}
+
+/*
+ * Put a chain head's deadline on the timer wheel. Jiffy resolution is
+ * enough: the timer only reclaims queue slots early, the exact check is
+ * at dequeue.
+ */
+static void xsc_req_arm(struct xsc_req *req, u64 now)
+{
+	u64 left = req->deadline_ns > now ? req->deadline_ns - now : 0;
+
+	timer_setup(&req->expire, xsc_req_expire, 0);
+	req->expire.expires = jiffies + nsecs_to_jiffies(left) + 1;
+	add_timer(&req->expire);
+}
+
+/*
+ * An XSC_F_DRAIN chain is running, or chains are deferred (behind a
+ * drain, or held by the cgroup limit): a new op must queue up rather
+ * than overtake them. Only the feeder adds to deferred, so the answer
+ * holds until it submits more.
+ */
+static bool xsc_sched_draining(struct xsc_ctx *ctx)
+{
+	bool draining;
+
+	spin_lock_bh(&ctx->sched_lock);
+	draining = ctx->drain_running || !list_empty(&ctx->deferred);
+	spin_unlock_bh(&ctx->sched_lock);
+	return draining;
+}
+
+/*
+ * xsc_sched_submit - Queue a consumed SQE for execution
+ *
+ * Called only from the SQ feeder, under sq_lock, which also covers the
+ * open link chain.
+ */
+int xsc_sched_submit(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+		     u64 seen_ns)
+{
+	struct xsc_req *req;
+	u32 key;
+
+	/*
+	 * Cancels, timeouts and polls run at once, from the feeder: a
+	 * cancel's targets may hold every worker slot, and arming a timer
+	 * or hooking a wait queue is not worth a worker. Linked or draining
+	 * ones keep their place in line, and so does any behind a drain
+	 * barrier.
+	 */
+	if (xsc_op_is_immediate(READ_ONCE(sqe->opcode)) && !ctx->link_head &&
+	    !xsc_sched_draining(ctx)) {
+		struct xsc_req creq = { .ctx = ctx, .seen_ns = seen_ns };
+
+		memcpy(&creq.sqe, sqe, sizeof(creq.sqe));
+		if (xsc_op_is_immediate(creq.sqe.opcode) &&
+		    !(creq.sqe.flags & (XSC_F_LINK | XSC_F_DRAIN))) {
+			xsc_issue_req(ctx, &creq);
+			return 0;
+		}
+	}
+
+	req = kmem_cache_alloc(xsc_req_cachep, GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	memcpy(&req->sqe, sqe, sizeof(req->sqe));
+	req->ctx = ctx;
+	req->seen_ns = seen_ns;
+	req->deadline_ns = 0;
+	if (req->sqe.flags & XSC_F_DEADLINE)
+		req->deadline_ns = max_t(u64, req->sqe.deadline_ns, 1);
+	req->link = NULL;
+	req->class = xsc_req_class(&req->sqe);
+	req->inline_exec = false;
+	req->cancelled = false;
+
+	/* Chain members are held back until the chain is closed */
+	if (ctx->link_head) {
+		ctx->link_tail->link = req;
+		ctx->link_tail = req;
+	} else {
+		ctx->link_head = req;
+		ctx->link_tail = req;
+	}
+	if (req->sqe.flags & XSC_F_LINK)
+		return 0;
+
+	req = ctx->link_head;
+	ctx->link_head = NULL;
+	ctx->link_tail = NULL;
+
+	/* The chain's fd may need a new domain: allocate it unlocked */
+	req->domain = NULL;
+	if (xsc_sqe_domain_key(&req->sqe, &key) && !ctx->domain_spare) {
+		ctx->domain_spare = kmalloc(sizeof(*ctx->domain_spare),
+					    GFP_KERNEL_ACCOUNT);
+		if (!ctx->domain_spare) {
+			xsc_fail_chain(ctx, req, -ENOMEM);
+			return 0;
+		}
+	}
+
+	spin_lock_bh(&ctx->sched_lock);
+	if (xsc_sqe_domain_key(&req->sqe, &key))
+		req->domain = xsc_domain_get(ctx, key);
+	req->state = XSC_REQ_DEFERRED;
+	list_add_tail(&req->node, &ctx->deferred);
+	if (req->deadline_ns)
+		xsc_req_arm(req, seen_ns);
+	xsc_sched_run_deferred(ctx);
+	spin_unlock_bh(&ctx->sched_lock);
+
+	return 0;
+}
+
+/*
+ * Route what the cgroup in-flight limit held back (xsc_fair.c). Returns
+ * false if the ring took no slot and is not waiting for one, so the slot
+ * it was woken for is still free.
+ */
+bool xsc_sched_resume(struct xsc_ctx *ctx)
+{
+	bool used = false;
+	u32 inflight;
+
+	spin_lock_bh(&ctx->sched_lock);
+	if (!ctx->sched_dying) {
+		inflight = ctx->inflight;
+		xsc_sched_run_deferred(ctx);
+		used = ctx->inflight != inflight ||
+		       !list_empty_careful(&ctx->fair_node);
+	}
+	spin_unlock_bh(&ctx->sched_lock);
+	return used;
+}
+
+/* Nothing routed or held back: inline execution cannot overtake */
+bool xsc_sched_idle(struct xsc_ctx *ctx)
+{
+	bool idle;
+
+	spin_lock_bh(&ctx->sched_lock);
+	idle = !ctx->inflight && list_empty(&ctx->deferred);
+	spin_unlock_bh(&ctx->sched_lock);
+	return idle;
+}
+
+const char *xsc_exec_mode_name(u8 mode)
+{
+	return mode < ARRAY_SIZE(xsc_exec_names) ? xsc_exec_names[mode] : "?";
+}
+
+static void xsc_exec_switch(struct xsc_ctx *ctx, u8 mode)
+{
+	WRITE_ONCE(ctx->exec_mode, mode);
+
+	/* A placement the ring asked for at setup is left alone */
+	if (ctx->place_pinned || mode == XSC_EXEC_INLINE)
+		return;
+	xsc_place_switch(ctx, mode == XSC_EXEC_SIBLING ? XSC_PLACE_SIBLING :
+							 XSC_PLACE_ISOLATE);
+}
+
+void xsc_exec_setup(struct xsc_ctx *ctx, bool place_pinned)
+{
+	ctx->place_pinned = place_pinned;
+	ctx->exec_window_ns = ktime_get_ns();
+	ctx->exec_mode = READ_ONCE(exec_auto) ? XSC_EXEC_INLINE :
+						XSC_EXEC_REMOTE;
+}
+
+/*
+ * xsc_exec_update - Re-evaluate a ring's execution mode
+ *
+ * Called on every kick; does work once per window. The window is
+ * claimed with a cmpxchg so concurrent submitters evaluate it once.
+ */
+void xsc_exec_update(struct xsc_ctx *ctx, u64 now)
+{
+	u64 start = READ_ONCE(ctx->exec_window_ns);
+	u64 elapsed = now - start;
+	u64 consumed, busy, rate, util;
+	u8 mode, next;
+
+	if (elapsed < XSC_EXEC_WINDOW_NS || !READ_ONCE(exec_auto))
+		return;
+	if (cmpxchg(&ctx->exec_window_ns, start, now) != start)
+		return;
+
+	consumed = READ_ONCE(ctx->sq_consumed);
+	busy = atomic64_read(&ctx->busy_ns);
+	rate = div64_u64((consumed - ctx->exec_last_consumed) * NSEC_PER_SEC,
+			 elapsed);
+	util = div64_u64((busy - ctx->exec_last_busy) * 100, elapsed);
+	ctx->exec_last_consumed = consumed;
+	ctx->exec_last_busy = busy;
+	ctx->exec_rate = (ctx->exec_rate * 3 + rate) / 4;
+
+	mode = READ_ONCE(ctx->exec_mode);
+	next = mode;
+	switch (mode) {
+	case XSC_EXEC_INLINE:
+		if (ctx->exec_rate > inline_qps)
+			next = XSC_EXEC_SIBLING;
+		break;
+	case XSC_EXEC_SIBLING:
+		if (util >= remote_util_pct)
+			next = XSC_EXEC_REMOTE;
+		else if (ctx->exec_rate < inline_qps / 2)
+			next = XSC_EXEC_INLINE;
+		break;
+	case XSC_EXEC_REMOTE:
+		if (util < remote_util_pct / 2)
+			next = XSC_EXEC_SIBLING;
+		break;
+	}
+
+	if (next == mode) {
+		ctx->exec_votes = 0;
+		return;
+	}
+	if (next != ctx->exec_next) {
+		ctx->exec_next = next;
+		ctx->exec_votes = 0;
+	}
+	if (++ctx->exec_votes < XSC_EXEC_VOTES)
+		return;
+
+	ctx->exec_votes = 0;
+	xsc_exec_switch(ctx, next);
+}
+
+int xsc_sched_setup(struct xsc_ctx *ctx, u32 nr_workers)
+{
+	int i;
+
+	if (!nr_workers)
+		nr_workers = READ_ONCE(max_workers);
+	nr_workers = clamp_t(u32, nr_workers, 1, WQ_MAX_ACTIVE - 1);
+
+	ctx->domains = kcalloc(XSC_NR_DOMAINS, sizeof(*ctx->domains),
+			       GFP_KERNEL);
+	ctx->workers = kcalloc(nr_workers, sizeof(*ctx->workers), GFP_KERNEL);
+	if (!ctx->domains || !ctx->workers)
+		goto err;
+	if (xsc_fair_setup(ctx))
+		goto err;
+
+	for (i = 0; i < XSC_NR_CLASSES; i++) {
+		INIT_LIST_HEAD(&ctx->runq[i]);
+		ctx->dl_runq[i] = RB_ROOT_CACHED;
+	}
+	for (i = 0; i < nr_workers; i++) {
+		INIT_WORK(&ctx->workers[i].work, xsc_worker_fn);
+		ctx->workers[i].ctx = ctx;
+	}
+	ctx->nr_workers = nr_workers;
+
+	/*
+	 * One more than the worker slots: all of them busy cannot use up
+	 * max_active and leave the feeder inactive behind them. It still
+	 * needs an idle kworker of the shared unbound pool like any work
+	 * item.
+	 */
+	ctx->wq = alloc_workqueue("xsc_wq", WQ_UNBOUND | WQ_HIGHPRI,
+				  nr_workers + 1);
+	if (!ctx->wq)
+		goto err;
+
+	return 0;
+
+err:
+	xsc_fair_release(ctx);
+	kfree(ctx->workers);
+	ctx->workers = NULL;
+	kfree(ctx->domains);
+	ctx->domains = NULL;
+	return -ENOMEM;
+}
+
+void xsc_sched_release(struct xsc_ctx *ctx)
+{
+	struct xsc_req *req, *tmp;
+	struct xsc_domain *d;
+	struct hlist_node *n;
+	int i;
+
+	/* From here on, expiring deadlines leave requests where they are */
+	spin_lock_bh(&ctx->sched_lock);
+	ctx->sched_dying = true;
+	spin_unlock_bh(&ctx->sched_lock);
+
+	if (ctx->wq) {
+		/* Completions may route deferred work, so drain, not flush */
+		drain_workqueue(ctx->wq);
+		destroy_workqueue(ctx->wq);
+		ctx->wq = NULL;
+	}
+	xsc_fair_release(ctx);
+	xsc_timeout_release(ctx);
+	xsc_poll_release(ctx);
+
+	/* A chain userspace never closed was never routed */
+	xsc_free_chain(ctx->link_head);
+	ctx->link_head = NULL;
+	ctx->link_tail = NULL;
+
+	list_for_each_entry_safe(req, tmp, &ctx->deferred, node) {
+		list_del(&req->node);
+		if (req->deadline_ns)
+			del_timer_sync(&req->expire);
+		xsc_free_chain(req);
+	}
+
+	/* The deferred chains freed above did not give theirs back */
+	for (i = 0; ctx->domains && i < XSC_NR_DOMAINS; i++)
+		hlist_for_each_entry_safe(d, n, &ctx->domains[i], node)
+			kfree(d);
+	kfree(ctx->domain_spare);
+	ctx->domain_spare = NULL;
+
+	kfree(ctx->workers);
+	ctx->workers = NULL;
+	kfree(ctx->domains);
+	ctx->domains = NULL;
+}
+
+void __init xsc_sched_init(void)
+{
+	xsc_req_cachep = KMEM_CACHE(xsc_req, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+}
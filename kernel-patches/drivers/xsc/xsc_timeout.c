@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC timeouts
+ * Copyright (C) 2025
+ *
+ * XSC_OP_LINK_TIMEOUT bounds the op linked right before it: when that op
+ * starts, an hrtimer is armed in its place, and if it fires first the op
+ * is cancelled the same way XSC_OP_ASYNC_CANCEL cancels a running op.
+ * No worker sleeps for the timeout itself. The timeout posts -ETIME if
+ * it fired, -ECANCELED if the op finished first; in the latter case the
+ * chain goes on past it as if it were not there.
+ *
+ * XSC_OP_TIMEOUT completes after a delay, posting -ETIME from the timer
+ * callback: arming it is all the issuing context does, so no worker
+ * sleeps however long the timeout. With XSC_F_MULTISHOT it is
+ * periodic and posts one CQE per period, flagged XSC_CQE_F_MORE until
+ * the last. The origin's timer slack applies, as for its own sleeps.
+ * XSC_OP_ASYNC_CANCEL by user_data (or any) removes an armed timeout,
+ * which then posts -ECANCELED.
+ *
+ * Timeouts take a struct __kernel_timespec at sqe->addr, relative to
+ * now on CLOCK_MONOTONIC, or absolute with XSC_TIMEOUT_ABS.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/sched/rt.h>
+#include <linux/ktime.h>
+#include <linux/time64.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/uaccess.h>
+
+#include "xsc_internal.h"
+
+struct xsc_timeout {
+	struct hrtimer		timer;
+	struct list_head	node;		/* ctx->timeouts */
+	struct xsc_ctx		*ctx;
+	u64			user_data;
+	ktime_t			period;		/* multishot only */
+	u32			shots;		/* left; 0: until cancelled */
+	bool			multishot;
+	bool			cancelled;	/* cancel raced with the callback */
+};
+
+static int xsc_timeout_read(struct xsc_ctx *ctx, const struct xsc_sqe *sqe,
+			    ktime_t *t)
+{
+	struct __kernel_timespec ts;
+	struct mm_struct *mm;
+	int ret = 0;
+
+	mm = get_task_mm(ctx->task);
+	if (!mm)
+		return -EINVAL;
+	xsc_use_mm(mm);
+	if (copy_from_user(&ts, u64_to_user_ptr(sqe->addr), sizeof(ts)))
+		ret = -EFAULT;
+	xsc_unuse_mm(mm);
+	mmput(mm);
+	if (ret)
+		return ret;
+
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NSEC_PER_SEC)
+		return -EINVAL;
+	*t = timespec64_to_ktime((struct timespec64){
+		.tv_sec = ts.tv_sec,
+		.tv_nsec = ts.tv_nsec,
+	});
+	return 0;
+}
+
+/* Softirq: the same path an XSC_OP_ASYNC_CANCEL takes for a running op */
+static enum hrtimer_restart xsc_ltimeout_fn(struct hrtimer *timer)
+{
+	struct xsc_req *lt = container_of(timer, struct xsc_req, htimer);
+	struct xsc_ctx *ctx = lt->ctx;
+
+	spin_lock(&ctx->sched_lock);
+	lt->cur->cancelled = true;
+	set_notify_signal(lt->task);
+	spin_unlock(&ctx->sched_lock);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * xsc_ltimeout_arm - Start the timeout bounding @target
+ *
+ * Called by the worker about to issue @target. On error neither runs.
+ */
+int xsc_ltimeout_arm(struct xsc_ctx *ctx, struct xsc_req *lt,
+		     struct xsc_req *target)
+{
+	enum hrtimer_mode mode;
+	ktime_t t;
+	int ret;
+
+	ret = xsc_check_restrictions(ctx, &lt->sqe);
+	if (ret)
+		return ret;
+	if (lt->sqe.timeout_flags & ~XSC_TIMEOUT_ABS)
+		return -EINVAL;
+	ret = xsc_timeout_read(ctx, &lt->sqe, &t);
+	if (ret)
+		return ret;
+
+	mode = lt->sqe.timeout_flags & XSC_TIMEOUT_ABS ? HRTIMER_MODE_ABS_SOFT :
+							 HRTIMER_MODE_REL_SOFT;
+	lt->task = current;
+	lt->cur = target;
+	hrtimer_init(&lt->htimer, CLOCK_MONOTONIC, mode);
+	lt->htimer.function = xsc_ltimeout_fn;
+	hrtimer_start(&lt->htimer, t, mode);
+	return 0;
+}
+
+/*
+ * xsc_ltimeout_disarm - Stop the timeout once @target returned
+ *
+ * Returns whether it fired. Waits for a running callback, so the target
+ * is never marked after this.
+ */
+bool xsc_ltimeout_disarm(struct xsc_req *lt)
+{
+	return !hrtimer_cancel(&lt->htimer);
+}
+
+/* The origin sleeping itself would get this much slack */
+static u64 xsc_timeout_slack(struct xsc_ctx *ctx)
+{
+	struct task_struct *task = ctx->task;
+
+	return rt_task(task) ? 0 : READ_ONCE(task->timer_slack_ns);
+}
+
+/*
+ * Softirq. The timeout removes and frees itself when done, under
+ * timeout_lock, so a canceller that found it on the list never sees it
+ * freed and one that did not never touches it.
+ */
+static enum hrtimer_restart xsc_timeout_fn(struct hrtimer *timer)
+{
+	struct xsc_timeout *t = container_of(timer, struct xsc_timeout, timer);
+	struct xsc_ctx *ctx = t->ctx;
+	bool more;
+
+	spin_lock(&ctx->timeout_lock);
+	if (t->cancelled) {
+		more = false;
+		xsc_post_cqe(ctx, XSC_OP_TIMEOUT, t->user_data, -ECANCELED, 0);
+	} else {
+		more = t->multishot && t->shots != 1;
+		xsc_post_cqe(ctx, XSC_OP_TIMEOUT, t->user_data, -ETIME,
+			     more ? XSC_CQE_F_MORE : 0);
+	}
+
+	if (more) {
+		if (t->shots)
+			t->shots--;
+		hrtimer_forward_now(timer, t->period);
+	} else {
+		list_del(&t->node);
+		kfree(t);
+	}
+	spin_unlock(&ctx->timeout_lock);
+
+	return more ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+/*
+ * xsc_timeout_start - XSC_OP_TIMEOUT
+ *
+ * Returns -EIOCBQUEUED once armed: the CQEs come from the callback.
+ */
+int xsc_timeout_start(struct xsc_ctx *ctx, const struct xsc_sqe *sqe)
+{
+	bool multishot = sqe->flags & XSC_F_MULTISHOT;
+	u32 flags = sqe->timeout_flags;
+	enum hrtimer_mode mode;
+	struct xsc_timeout *t;
+	ktime_t when;
+	int ret;
+
+	if (flags & ~XSC_TIMEOUT_ABS)
+		return -EINVAL;
+	/* A period is relative; the chain after a timeout would not wait */
+	if ((flags & XSC_TIMEOUT_ABS && multishot) || sqe->flags & XSC_F_LINK)
+		return -EINVAL;
+
+	ret = xsc_timeout_read(ctx, sqe, &when);
+	if (ret)
+		return ret;
+	if (multishot && !when)
+		return -EINVAL;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->ctx = ctx;
+	t->user_data = sqe->user_data;
+	t->multishot = multishot;
+	t->period = when;
+	t->shots = sqe->len;
+
+	mode = flags & XSC_TIMEOUT_ABS ? HRTIMER_MODE_ABS_SOFT :
+					 HRTIMER_MODE_REL_SOFT;
+	hrtimer_init(&t->timer, CLOCK_MONOTONIC, mode);
+	t->timer.function = xsc_timeout_fn;
+
+	spin_lock_bh(&ctx->timeout_lock);
+	list_add_tail(&t->node, &ctx->timeouts);
+	hrtimer_start_range_ns(&t->timer, when, xsc_timeout_slack(ctx), mode);
+	spin_unlock_bh(&ctx->timeout_lock);
+
+	return -EIOCBQUEUED;
+}
+
+/*
+ * xsc_timeout_cancel - Remove armed timeouts matching a cancel
+ *
+ * Only user_data or XSC_CANCEL_ANY match a timeout. One whose callback
+ * is running is marked and posts -ECANCELED from there. Returns the
+ * number cancelled.
+ */
+int xsc_timeout_cancel(struct xsc_ctx *ctx, u64 user_data, u32 cancel_flags)
+{
+	struct xsc_timeout *t, *tmp;
+	int nr = 0;
+
+	if (cancel_flags & XSC_CANCEL_FD)
+		return 0;
+
+	spin_lock_bh(&ctx->timeout_lock);
+	list_for_each_entry_safe(t, tmp, &ctx->timeouts, node) {
+		if (t->cancelled)
+			continue;
+		if (!(cancel_flags & XSC_CANCEL_ANY) && t->user_data != user_data)
+			continue;
+
+		if (hrtimer_try_to_cancel(&t->timer) < 0) {
+			t->cancelled = true;
+		} else {
+			list_del(&t->node);
+			xsc_post_cqe(ctx, XSC_OP_TIMEOUT, t->user_data,
+				     -ECANCELED, 0);
+			kfree(t);
+		}
+		nr++;
+		if (!(cancel_flags & XSC_CANCEL_ALL))
+			break;
+	}
+	spin_unlock_bh(&ctx->timeout_lock);
+	return nr;
+}
+
+/*
+ * xsc_timeout_release - Cancel every timeout and wait for the callbacks
+ *
+ * Called once nothing can arm a timeout any more.
+ */
+void xsc_timeout_release(struct xsc_ctx *ctx)
+{
+	bool empty;
+
+	for (;;) {
+		xsc_timeout_cancel(ctx, 0, XSC_CANCEL_ANY | XSC_CANCEL_ALL);
+		spin_lock_bh(&ctx->timeout_lock);
+		empty = list_empty(&ctx->timeouts);
+		spin_unlock_bh(&ctx->timeout_lock);
+		if (empty)
+			break;
+		usleep_range(100, 200);
+	}
+}
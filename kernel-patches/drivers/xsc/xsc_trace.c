@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * XSC tracepoint definitions (v8-D §5.2)
+ * Copyright (C) 2025
+ *
+ * All XSC tracepoints are instantiated here. Callers on the worker hot
+ * path test trace_<event>_enabled() first, so a disabled event costs a
+ * single patched-out branch and no argument marshalling.
+ */
+
+#include <linux/module.h>
+
+#include "xsc_internal.h"
+
+#define CREATE_TRACE_POINTS
+#include "xsc_trace.h"
+
+void xsc_trace_sys_enter(struct xsc_tp_enter *tpe)
+{
+	trace_xsc_sys_enter(tpe);
+}
+EXPORT_SYMBOL_GPL(xsc_trace_sys_enter);
+
+void xsc_trace_sys_exit(struct xsc_tp_exit *tpx)
+{
+	trace_xsc_sys_exit(tpx);
+}
+EXPORT_SYMBOL_GPL(xsc_trace_sys_exit);
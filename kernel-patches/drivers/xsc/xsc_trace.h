@@ -10,68 +10,212 @@
 #define _TRACE_XSC_H
 
 #include <linux/tracepoint.h>
+#include "xsc_internal.h"
 
+/*
+ * Per-SQE lifecycle. Every event carries the ring id, opcode and
+ * user_data so BPF tools can stitch one op's timeline together:
+ *
+ *   xsc_submit   - SQE first observed at the SQ tail
+ *   xsc_dequeue  - worker takes the SQE (wait_ns = time since submit)
+ *   xsc_dispatch - handler entered on @cpu
+ *   xsc_block    - handler slept or was preempted while running
+ *   xsc_complete - CQE posted
+ *   xsc_reap     - kernel observed userspace consuming the CQE
+ */
 TRACE_EVENT(xsc_submit,
-	TP_PROTO(void *ctx, u8 opcode, u64 user_data),
+	TP_PROTO(const struct xsc_ctx *ctx, u8 opcode, u64 user_data),
 
 	TP_ARGS(ctx, opcode, user_data),
 
 	TP_STRUCT__entry(
-		__field(void *,		ctx)
+		__field(u32,		ctx_id)
 		__field(u8,		opcode)
 		__field(u64,		user_data)
 	),
 
 	TP_fast_assign(
-		__entry->ctx		= ctx;
+		__entry->ctx_id		= ctx->id;
 		__entry->opcode		= opcode;
 		__entry->user_data	= user_data;
 	),
 
-	TP_printk("ctx %p, op %u, user_data 0x%llx",
-		  __entry->ctx, __entry->opcode, __entry->user_data)
+	TP_printk("ring %u, op %u, user_data 0x%llx",
+		  __entry->ctx_id, __entry->opcode, __entry->user_data)
+);
+
+TRACE_EVENT(xsc_dequeue,
+	TP_PROTO(const struct xsc_ctx *ctx, u8 opcode, u64 user_data,
+		 u64 wait_ns),
+
+	TP_ARGS(ctx, opcode, user_data, wait_ns),
+
+	TP_STRUCT__entry(
+		__field(u32,		ctx_id)
+		__field(u8,		opcode)
+		__field(u64,		user_data)
+		__field(u64,		wait_ns)
+	),
+
+	TP_fast_assign(
+		__entry->ctx_id		= ctx->id;
+		__entry->opcode		= opcode;
+		__entry->user_data	= user_data;
+		__entry->wait_ns	= wait_ns;
+	),
+
+	TP_printk("ring %u, op %u, user_data 0x%llx, wait %llu ns",
+		  __entry->ctx_id, __entry->opcode, __entry->user_data,
+		  __entry->wait_ns)
 );
 
 TRACE_EVENT(xsc_dispatch,
-	TP_PROTO(void *ctx, u8 opcode, int cpu),
+	TP_PROTO(const struct xsc_ctx *ctx, u8 opcode, u64 user_data, int cpu),
 
-	TP_ARGS(ctx, opcode, cpu),
+	TP_ARGS(ctx, opcode, user_data, cpu),
 
 	TP_STRUCT__entry(
-		__field(void *,		ctx)
+		__field(u32,		ctx_id)
 		__field(u8,		opcode)
+		__field(u64,		user_data)
 		__field(int,		cpu)
 	),
 
 	TP_fast_assign(
-		__entry->ctx		= ctx;
+		__entry->ctx_id		= ctx->id;
 		__entry->opcode		= opcode;
+		__entry->user_data	= user_data;
 		__entry->cpu		= cpu;
 	),
 
-	TP_printk("ctx %p, op %u, cpu %d",
-		  __entry->ctx, __entry->opcode, __entry->cpu)
+	TP_printk("ring %u, op %u, user_data 0x%llx, cpu %d",
+		  __entry->ctx_id, __entry->opcode, __entry->user_data,
+		  __entry->cpu)
+);
+
+TRACE_EVENT(xsc_block,
+	TP_PROTO(const struct xsc_ctx *ctx, u8 opcode, u64 user_data,
+		 unsigned long nvcsw, unsigned long nivcsw),
+
+	TP_ARGS(ctx, opcode, user_data, nvcsw, nivcsw),
+
+	TP_STRUCT__entry(
+		__field(u32,		ctx_id)
+		__field(u8,		opcode)
+		__field(u64,		user_data)
+		__field(unsigned long,	nvcsw)
+		__field(unsigned long,	nivcsw)
+	),
+
+	TP_fast_assign(
+		__entry->ctx_id		= ctx->id;
+		__entry->opcode		= opcode;
+		__entry->user_data	= user_data;
+		__entry->nvcsw		= nvcsw;
+		__entry->nivcsw		= nivcsw;
+	),
+
+	TP_printk("ring %u, op %u, user_data 0x%llx, slept %lu, preempted %lu",
+		  __entry->ctx_id, __entry->opcode, __entry->user_data,
+		  __entry->nvcsw, __entry->nivcsw)
 );
 
 TRACE_EVENT(xsc_complete,
-	TP_PROTO(void *ctx, u64 user_data, s32 res),
+	TP_PROTO(const struct xsc_ctx *ctx, u8 opcode, u64 user_data, s32 res),
+
+	TP_ARGS(ctx, opcode, user_data, res),
+
+	TP_STRUCT__entry(
+		__field(u32,		ctx_id)
+		__field(u8,		opcode)
+		__field(u64,		user_data)
+		__field(s32,		res)
+	),
+
+	TP_fast_assign(
+		__entry->ctx_id		= ctx->id;
+		__entry->opcode		= opcode;
+		__entry->user_data	= user_data;
+		__entry->res		= res;
+	),
+
+	TP_printk("ring %u, op %u, user_data 0x%llx, res %d",
+		  __entry->ctx_id, __entry->opcode, __entry->user_data,
+		  __entry->res)
+);
+
+TRACE_EVENT(xsc_reap,
+	TP_PROTO(const struct xsc_ctx *ctx, u64 user_data, s32 res),
 
 	TP_ARGS(ctx, user_data, res),
 
 	TP_STRUCT__entry(
-		__field(void *,		ctx)
+		__field(u32,		ctx_id)
 		__field(u64,		user_data)
 		__field(s32,		res)
 	),
 
 	TP_fast_assign(
-		__entry->ctx		= ctx;
+		__entry->ctx_id		= ctx->id;
 		__entry->user_data	= user_data;
 		__entry->res		= res;
 	),
 
-	TP_printk("ctx %p, user_data 0x%llx, res %d",
-		  __entry->ctx, __entry->user_data, __entry->res)
+	TP_printk("ring %u, user_data 0x%llx, res %d",
+		  __entry->ctx_id, __entry->user_data, __entry->res)
+);
+
+/* v8-D §5.2: semantic syscall entry/exit, fields mirror struct xsc_tp_* */
+TRACE_EVENT(xsc_sys_enter,
+	TP_PROTO(const struct xsc_tp_enter *tpe),
+
+	TP_ARGS(tpe),
+
+	TP_STRUCT__entry(
+		__field(u32,		pid)
+		__field(u32,		tgid)
+		__field(u64,		cgroup_id)
+		__field(u64,		nr)
+		__array(u64,		args, 6)
+		__field(u64,		ts_nsec)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= tpe->pid;
+		__entry->tgid		= tpe->tgid;
+		__entry->cgroup_id	= tpe->cgroup_id;
+		__entry->nr		= tpe->nr;
+		memcpy(__entry->args, tpe->args, sizeof(__entry->args));
+		__entry->ts_nsec	= tpe->ts_nsec;
+	),
+
+	TP_printk("pid %u tgid %u cgroup %llu NR %llu (%llx, %llx, %llx, %llx, %llx, %llx)",
+		  __entry->pid, __entry->tgid, __entry->cgroup_id, __entry->nr,
+		  __entry->args[0], __entry->args[1], __entry->args[2],
+		  __entry->args[3], __entry->args[4], __entry->args[5])
+);
+
+TRACE_EVENT(xsc_sys_exit,
+	TP_PROTO(const struct xsc_tp_exit *tpx),
+
+	TP_ARGS(tpx),
+
+	TP_STRUCT__entry(
+		__field(u32,		pid)
+		__field(u32,		tgid)
+		__field(s64,		ret)
+		__field(u64,		ts_nsec)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= tpx->pid;
+		__entry->tgid		= tpx->tgid;
+		__entry->ret		= tpx->ret;
+		__entry->ts_nsec	= tpx->ts_nsec;
+	),
+
+	TP_printk("pid %u tgid %u ret %lld",
+		  __entry->pid, __entry->tgid, __entry->ret)
 );
 
 TRACE_EVENT(xsc_drop,
@@ -45,6 +45,23 @@
 #define XSC_OP_SOCKET		29
 #define XSC_OP_BIND		30
 #define XSC_OP_LISTEN		31
+#define XSC_OP_ASYNC_CANCEL	32	/* Cancel ops matching addr/fd */
+#define XSC_OP_LINK_TIMEOUT	33	/* Bound the linked op before it */
+#define XSC_OP_TIMEOUT		34	/* Complete after a delay */
+#define XSC_OP_POLL_ADD		35	/* Notify on readiness, no worker */
+#define XSC_OP_POLL_REMOVE	36	/* Remove a POLL_ADD by addr */
+#define XSC_OP_SEND_ZC		37	/* Zero-copy sendto, then a notification */
+#define XSC_OP_SENDMSG		38	/* addr: struct msghdr */
+#define XSC_OP_RECVMSG		39
+#define XSC_OP_SENDMMSG		40	/* addr: struct mmsghdr[len] */
+#define XSC_OP_RECVMMSG		41	/* ... addr2: timeout, optional */
+#define XSC_OP_SPLICE		42	/* splice_fd_in -> fd */
+#define XSC_OP_TEE		43
+#define XSC_OP_SENDFILE		44
+#define XSC_OP_COPY_FILE_RANGE	45	/* splice_fd_in -> fd, in the fs */
+#define XSC_OP_CLONE_RANGE	46	/* ... as a reflink */
+
+#define XSC_OP_LAST		47	/* One past the highest valid opcode */
 
 /*
  * XSC Flags
@@ -53,6 +70,67 @@
 #define XSC_F_DRAIN		(1U << 1)	/* Drain prior ops */
 #define XSC_F_IOSQE_ASYNC	(1U << 2)	/* Force async */
 #define XSC_F_FIXED_FILE	(1U << 3)	/* Fixed file descriptor */
+#define XSC_F_DEADLINE		(1U << 4)	/* deadline_ns is set */
+#define XSC_F_MULTISHOT		(1U << 5)	/* Stay armed, one CQE per result */
+#define XSC_F_BUFFER_SELECT	(1U << 6)	/* Buffer from sqe->buf_group */
+
+/*
+ * XSC_F_FIXED_FILE applies to the ops that act on an open file (READ,
+ * WRITE, PREAD, PWRITE, READV, WRITEV, FSYNC, FSTAT, the splice and copy
+ * range ops, POLL_ADD), SEND_ZC, SENDMSG, RECVMSG, multishot RECVFROM,
+ * and XSC_OP_ASYNC_CANCEL's fd match. Any other op fails it with -EINVAL.
+ */
+
+/*
+ * XSC_F_MULTISHOT applies to RECVFROM, TIMEOUT and POLL_ADD, and
+ * not with XSC_F_LINK. Every CQE but the last is flagged XSC_CQE_F_MORE;
+ * the op stays armed until it fails, runs out or is cancelled.
+ */
+
+/*
+ * XSC_OP_ASYNC_CANCEL cancel_flags. By default the first op whose
+ * user_data equals sqe->addr is cancelled.
+ */
+#define XSC_CANCEL_ALL		(1U << 0)	/* Every match, not the first */
+#define XSC_CANCEL_FD		(1U << 1)	/* Match sqe->fd, not user_data */
+#define XSC_CANCEL_ANY		(1U << 2)	/* Match any op */
+
+/*
+ * Timeout ops: sqe->addr points to a struct __kernel_timespec on
+ * CLOCK_MONOTONIC, relative unless XSC_TIMEOUT_ABS. An XSC_OP_TIMEOUT
+ * with XSC_F_MULTISHOT fires every period, sqe->len times (0: until
+ * cancelled), each CQE but the last flagged XSC_CQE_F_MORE.
+ */
+#define XSC_TIMEOUT_ABS		(1U << 0)
+
+/*
+ * XSC_OP_POLL_ADD: sqe->poll32_events holds the POLL* events; sqe->len
+ * must be 0. Each CQE's res is the ready mask. With XSC_F_MULTISHOT the
+ * poll posts on every readiness edge, flagged XSC_CQE_F_MORE, until
+ * removed.
+ */
+
+/*
+ * Splice ops move len bytes from splice_fd_in (at splice_off_in) to fd
+ * (at off) in the kernel; an offset of -1 means the file position, and
+ * TEE takes none. splice_flags holds SPLICE_F_* (none for SENDFILE) and
+ * XSC_SPLICE_F_FD_IN_FIXED, which makes splice_fd_in a fixed-file slot
+ * as XSC_F_FIXED_FILE does fd.
+ */
+#define XSC_SPLICE_F_FD_IN_FIXED	(1U << 31)
+
+/*
+ * XSC_OP_COPY_FILE_RANGE and XSC_OP_CLONE_RANGE take the same fields,
+ * with the byte count in copy_len; splice_flags allows only
+ * XSC_SPLICE_F_FD_IN_FIXED. The filesystem does the copy, or shares
+ * the extents for a clone. A CQE flagged XSC_CQE_F_MORE is posted every
+ * len bytes (0: every ~2 GiB); each CQE's res counts the bytes done
+ * since the previous one. For a clone, len must be a multiple of the
+ * destination's block size (-EINVAL). A short copy stops at EOF. A
+ * failure or cancel first posts the bytes done since the last progress
+ * CQE, flagged XSC_CQE_F_MORE, then the error. A clone with copy_len 0
+ * goes to EOF in one step and completes with res 0.
+ */
 
 /*
  * Submission Queue Entry (SQE)
@@ -96,7 +174,11 @@ struct xsc_sqe {
 		__s32	splice_fd_in;
 		__u32	file_index;
 	};
-	__u64	__pad2[2];
+	__u64	deadline_ns;	/* CLOCK_MONOTONIC, with XSC_F_DEADLINE */
+	union {
+		__u64	copy_len;	/* Copy/clone range ops: bytes */
+		__u64	__pad2;
+	};
 };
 
 /*
@@ -108,6 +190,13 @@ struct xsc_cqe {
 	__u32	flags;		/* Completion flags */
 };
 
+#define XSC_CQE_F_MORE		(1U << 0)	/* More CQEs follow for this SQE */
+#define XSC_CQE_F_BUFFER	(1U << 1)	/* Provided buffer id in upper bits */
+#define XSC_CQE_F_NOTIF		(1U << 2)	/* XSC_OP_SEND_ZC buffer released */
+#define XSC_CQE_F_COPIED	(1U << 3)	/* ... but the data was copied */
+
+#define XSC_CQE_BUFFER_SHIFT	16
+
 /*
  * XSC Device Setup Structures
  */
@@ -141,11 +230,20 @@ struct xsc_params {
 	__u32	sq_thread_idle;
 	__u32	features;
 	__u32	wq_fd;
-	__u32	resv[3];
+	__u32	max_workers;	/* concurrent workers, 0: xsc.max_workers */
+	__u32	placement;	/* XSC_PLACE_*, 0: xsc.placement */
+	__u32	resv;
 	struct xsc_sqe_ring sq_off;
 	struct xsc_cqe_ring cq_off;
 };
 
+/* xsc_params.placement: where workers run relative to the submitter */
+#define XSC_PLACE_DEFAULT	0
+#define XSC_PLACE_ANY		1	/* no constraint */
+#define XSC_PLACE_SIBLING	2	/* submitter's core (SMT siblings) */
+#define XSC_PLACE_LLC		3	/* submitter's LLC, other cores */
+#define XSC_PLACE_ISOLATE	4	/* any core but the submitter's */
+
 /*
  * IOCTLs
  */
@@ -153,11 +251,89 @@ struct xsc_params {
 #define XSC_IOC_SETUP		_IOWR(XSC_IOC_MAGIC, 0, struct xsc_params)
 #define XSC_IOC_REGISTER_FILES	_IOW(XSC_IOC_MAGIC, 1, struct xsc_files_update)
 #define XSC_IOC_UNREGISTER_FILES _IO(XSC_IOC_MAGIC, 2)
+#define XSC_IOC_REGISTER_RESTRICTIONS _IOW(XSC_IOC_MAGIC, 3, struct xsc_restrictions)
+#define XSC_IOC_FLIGHT_RECORDER	_IOWR(XSC_IOC_MAGIC, 4, struct xsc_frec_read)
+#define XSC_IOC_PROVIDE_BUFFERS	_IOW(XSC_IOC_MAGIC, 5, struct xsc_buf_reg)
+
+/*
+ * Fixed files: a ring has XSC_MAX_FIXED_FILES slots. Each call sets nr
+ * of them from offset on; offset + nr may not exceed the limit.
+ */
+#define XSC_MAX_FIXED_FILES	1024
 
 struct xsc_files_update {
 	__u32	offset;
+	__u32	nr;		/* Number of entries in fds */
+	__aligned_u64 fds;	/* __s32 array, -1 clears a slot */
+};
+
+/*
+ * Provided buffers: nr buffers of len bytes, back to back from addr, are
+ * added to group bgid with ids bid, bid + 1, ... An SQE with
+ * XSC_F_BUFFER_SELECT takes one when it has data for it; its CQE carries
+ * XSC_CQE_F_BUFFER and the id in cqe->flags >> XSC_CQE_BUFFER_SHIFT.
+ * Provide the buffer again once done with its contents. A ring has at
+ * most XSC_MAX_BUF_GROUPS groups; providing to a new one past that fails
+ * with -ENOSPC.
+ */
+#define XSC_MAX_BUF_GROUPS	256
+
+struct xsc_buf_reg {
+	__aligned_u64 addr;
+	__u32	len;
+	__u16	nr;
+	__u16	bgid;
+	__u16	bid;
+	__u16	resv[3];
+};
+
+/*
+ * Ring restrictions
+ *
+ * Registered once per ring and never lifted. After registration every
+ * SQE must use an opcode set in sqe_op, carry no flags outside
+ * sqe_flags_allowed and all of sqe_flags_required. When nr_file_slots is
+ * non-zero, SQEs using XSC_F_FIXED_FILE may only name slots whose bit is
+ * set in the file_slots bitmap. Violations complete with -EACCES. The
+ * fixed-file table is frozen as well: REGISTER_FILES and UNREGISTER_FILES
+ * fail with -EACCES.
+ */
+#define XSC_RESTRICT_OP_WORDS	4	/* 256 opcode bits */
+
+struct xsc_restrictions {
+	__u64	sqe_op[XSC_RESTRICT_OP_WORDS];	/* Bitmap of allowed XSC_OP_* */
+	__u8	sqe_flags_allowed;		/* XSC_F_* that may be set */
+	__u8	sqe_flags_required;		/* XSC_F_* that must be set */
+	__u16	resv;
+	__u32	nr_file_slots;			/* Bits in file_slots, 0 = any */
+	__aligned_u64 file_slots;		/* __u64 bitmap of fixed-file slots */
+	__u64	resv2[2];
+};
+
+/*
+ * Flight recorder
+ *
+ * Each ring keeps the last N ops its workers executed. XSC_IOC_FLIGHT_RECORDER
+ * copies up to nr of the most recent entries, oldest first, and returns
+ * the number copied in nr. Entries overwritten while being read are
+ * skipped. Timestamps are CLOCK_MONOTONIC ns.
+ */
+struct xsc_frec_entry {
+	__u64	user_data;
+	__u64	dequeue_ns;
+	__u64	complete_ns;
+	__s32	fd;
+	__s32	res;
+	__u8	opcode;
+	__u8	resv;
+	__u16	cpu;		/* CPU the op completed on */
+	__u32	seq;		/* Internal, odd while being written */
+};
+
+struct xsc_frec_read {
+	__u32	nr;		/* In: capacity, out: entries copied */
 	__u32	resv;
-	__aligned_u64 fds;
+	__aligned_u64 entries;	/* struct xsc_frec_entry array */
 };
 
 /*
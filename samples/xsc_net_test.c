@@ -0,0 +1,356 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Network op checks for the XSC ring interface.
+ * Matches the v8 UAPI (see kernel-patches/drivers/xsc/xsc_uapi.h).
+ *
+ * Each test sets up its own ring and prints PASS or FAIL; the exit
+ * status is the number of failures.
+ */
+
+#define _GNU_SOURCE		/* struct mmsghdr */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "../kernel-patches/drivers/xsc/xsc_uapi.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+struct ring {
+	int		fd;
+	struct xsc_sqe	*sqes;
+	struct xsc_cqe	*cqes;
+	uint32_t	*sq_tail, *sq_mask;
+	uint32_t	*cq_head, *cq_tail, *cq_mask;
+};
+
+static int failures;
+
+static void fatal(const char *msg)
+{
+	perror(msg);
+	exit(EXIT_FAILURE);
+}
+
+static void report(const char *name, int ok)
+{
+	printf("%s: %s\n", ok ? "PASS" : "FAIL", name);
+	if (!ok)
+		failures++;
+}
+
+static void ring_setup(struct ring *r)
+{
+	struct xsc_params params;
+	uint32_t *sq_ring, *cq_ring;
+
+	r->fd = open("/dev/xsc", O_RDWR);
+	if (r->fd < 0)
+		fatal("open /dev/xsc");
+
+	memset(&params, 0, sizeof(params));
+	params.sq_entries = 64;
+	params.cq_entries = 64;
+	if (ioctl(r->fd, XSC_IOC_SETUP, &params) < 0)
+		fatal("XSC_IOC_SETUP");
+
+	sq_ring = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+	cq_ring = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED,
+		       r->fd, 0x10000000);
+	r->sqes = mmap(NULL, params.sq_entries * sizeof(*r->sqes),
+		       PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0x20000000);
+	r->cqes = mmap(NULL, params.cq_entries * sizeof(*r->cqes),
+		       PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0x30000000);
+	if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED ||
+	    r->sqes == MAP_FAILED || r->cqes == MAP_FAILED)
+		fatal("mmap");
+
+	r->sq_tail = sq_ring + 1;
+	r->sq_mask = sq_ring + 2;
+	r->cq_head = cq_ring;
+	r->cq_tail = cq_ring + 1;
+	r->cq_mask = cq_ring + 2;
+}
+
+static void ring_exit(struct ring *r)
+{
+	close(r->fd);
+}
+
+static struct xsc_sqe *ring_sqe(struct ring *r, uint8_t opcode, int fd,
+				uint64_t user_data)
+{
+	struct xsc_sqe *sqe = &r->sqes[*r->sq_tail & *r->sq_mask];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = user_data;
+	return sqe;
+}
+
+static void ring_submit(struct ring *r)
+{
+	__sync_synchronize();
+	*r->sq_tail += 1;
+}
+
+/* Submit the SQE from ring_sqe() and return its CQE's res */
+static int ring_run(struct ring *r)
+{
+	struct pollfd pfd = { .fd = r->fd, .events = POLLIN };
+	struct xsc_cqe *cqe;
+	int res;
+
+	ring_submit(r);
+	while (*(volatile uint32_t *)r->cq_head ==
+	       *(volatile uint32_t *)r->cq_tail) {
+		if (poll(&pfd, 1, 5000) <= 0)
+			fatal("poll");
+	}
+	__sync_synchronize();
+	cqe = &r->cqes[*r->cq_head & *r->cq_mask];
+	res = cqe->res;
+	*r->cq_head += 1;
+	return res;
+}
+
+static void register_slot(struct ring *r, int fd)
+{
+	struct xsc_files_update up;
+
+	memset(&up, 0, sizeof(up));
+	up.nr = 1;
+	up.fds = (uintptr_t)&fd;
+	if (ioctl(r->fd, XSC_IOC_REGISTER_FILES, &up) < 0)
+		fatal("XSC_IOC_REGISTER_FILES");
+}
+
+static void udp_pair(int fds[2])
+{
+	struct sockaddr_in sin = { .sin_family = AF_INET };
+	socklen_t len = sizeof(sin);
+	int i;
+
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	for (i = 0; i < 2; i++) {
+		fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fds[i] < 0)
+			fatal("socket");
+		sin.sin_port = 0;
+		if (bind(fds[i], (struct sockaddr *)&sin, sizeof(sin)) < 0)
+			fatal("bind");
+	}
+	/* Each end connected to the other */
+	for (i = 0; i < 2; i++) {
+		if (getsockname(fds[!i], (struct sockaddr *)&sin, &len) < 0)
+			fatal("getsockname");
+		if (connect(fds[i], (struct sockaddr *)&sin, sizeof(sin)) < 0)
+			fatal("connect");
+	}
+}
+
+/*
+ * A ring locked to fixed files must not reach plain fds through ops that
+ * take sqe->fd as an fd number: slot 0 is allowed, but fd 0 is not the
+ * socket in slot 0.
+ */
+static void test_restricted_fixed_net(void)
+{
+	struct xsc_restrictions res;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	uint64_t slots = 1;
+	struct xsc_sqe *sqe;
+	struct ring r;
+	int fds[2], ret;
+	char c = 'x';
+
+	udp_pair(fds);
+	ring_setup(&r);
+
+	register_slot(&r, fds[0]);
+
+	memset(&res, 0, sizeof(res));
+	res.sqe_op[0] = 1ULL << XSC_OP_CONNECT | 1ULL << XSC_OP_SENDTO;
+	res.sqe_flags_allowed = XSC_F_FIXED_FILE;
+	res.sqe_flags_required = XSC_F_FIXED_FILE;
+	res.nr_file_slots = 1;
+	res.file_slots = (uintptr_t)&slots;
+	if (ioctl(r.fd, XSC_IOC_REGISTER_RESTRICTIONS, &res) < 0)
+		fatal("XSC_IOC_REGISTER_RESTRICTIONS");
+
+	if (getsockname(fds[1], (struct sockaddr *)&sin, &len) < 0)
+		fatal("getsockname");
+
+	sqe = ring_sqe(&r, XSC_OP_CONNECT, 0, 1);
+	sqe->flags = XSC_F_FIXED_FILE;
+	sqe->addr = (uintptr_t)&sin;
+	sqe->len = sizeof(sin);
+	ret = ring_run(&r);
+	report("restricted CONNECT with FIXED_FILE is rejected", ret == -EINVAL);
+
+	sqe = ring_sqe(&r, XSC_OP_SENDTO, 0, 2);
+	sqe->flags = XSC_F_FIXED_FILE;
+	sqe->addr = (uintptr_t)&c;
+	sqe->len = 1;
+	ret = ring_run(&r);
+	report("restricted SENDTO with FIXED_FILE is rejected", ret == -EINVAL);
+
+	ring_exit(&r);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/* SENDMSG on fixed slot 0, RECVMSG on the plain fd of the other end */
+static void test_msg_roundtrip(void)
+{
+	char out[] = "sendmsg", in[16] = {};
+	struct iovec siov = { out, sizeof(out) }, riov = { in, sizeof(in) };
+	struct msghdr smsg = { .msg_iov = &siov, .msg_iovlen = 1 };
+	struct msghdr rmsg = { .msg_iov = &riov, .msg_iovlen = 1 };
+	struct xsc_sqe *sqe;
+	struct ring r;
+	int fds[2], ret;
+
+	udp_pair(fds);
+	ring_setup(&r);
+	register_slot(&r, fds[0]);
+
+	sqe = ring_sqe(&r, XSC_OP_SENDMSG, 0, 1);
+	sqe->flags = XSC_F_FIXED_FILE;
+	sqe->addr = (uintptr_t)&smsg;
+	ret = ring_run(&r);
+	report("SENDMSG on a fixed file", ret == sizeof(out));
+
+	sqe = ring_sqe(&r, XSC_OP_RECVMSG, fds[1], 2);
+	sqe->addr = (uintptr_t)&rmsg;
+	ret = ring_run(&r);
+	report("RECVMSG round trip",
+	       ret == sizeof(out) && !memcmp(in, out, sizeof(out)));
+
+	ring_exit(&r);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/* One SENDMSG with a UDP_SEGMENT cmsg arrives as gso_size datagrams */
+static void test_msg_udp_segment(void)
+{
+	char out[12] = "abcdefghijkl", in[16];
+	union {
+		char		buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr	align;
+	} ctl;
+	struct iovec siov = { out, sizeof(out) }, riov = { in, sizeof(in) };
+	struct msghdr smsg = {
+		.msg_iov = &siov, .msg_iovlen = 1,
+		.msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf),
+	};
+	struct msghdr rmsg = { .msg_iov = &riov, .msg_iovlen = 1 };
+	struct cmsghdr *cm;
+	struct xsc_sqe *sqe;
+	struct ring r;
+	int fds[2], ret, i, ok;
+
+	udp_pair(fds);
+	ring_setup(&r);
+
+	memset(&ctl, 0, sizeof(ctl));
+	cm = CMSG_FIRSTHDR(&smsg);
+	cm->cmsg_level = SOL_UDP;
+	cm->cmsg_type = UDP_SEGMENT;
+	cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t *)CMSG_DATA(cm) = 4;
+
+	sqe = ring_sqe(&r, XSC_OP_SENDMSG, fds[0], 1);
+	sqe->addr = (uintptr_t)&smsg;
+	ret = ring_run(&r);
+	ok = ret == sizeof(out);
+
+	for (i = 0; ok && i < 3; i++) {
+		sqe = ring_sqe(&r, XSC_OP_RECVMSG, fds[1], 2 + i);
+		sqe->addr = (uintptr_t)&rmsg;
+		ret = ring_run(&r);
+		ok = ret == 4 && !memcmp(in, out + 4 * i, 4);
+	}
+	report("SENDMSG with UDP_SEGMENT splits into segments", ok);
+
+	ring_exit(&r);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_mmsg_roundtrip(void)
+{
+	char out[2][8] = { "first", "second" }, in[2][8] = {};
+	struct iovec siov[2], riov[2];
+	struct mmsghdr smsg[2], rmsg[2];
+	struct xsc_sqe *sqe;
+	struct ring r;
+	int fds[2], ret, i, ok;
+
+	memset(smsg, 0, sizeof(smsg));
+	memset(rmsg, 0, sizeof(rmsg));
+	for (i = 0; i < 2; i++) {
+		siov[i].iov_base = out[i];
+		siov[i].iov_len = sizeof(out[i]);
+		smsg[i].msg_hdr.msg_iov = &siov[i];
+		smsg[i].msg_hdr.msg_iovlen = 1;
+		riov[i].iov_base = in[i];
+		riov[i].iov_len = sizeof(in[i]);
+		rmsg[i].msg_hdr.msg_iov = &riov[i];
+		rmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	udp_pair(fds);
+	ring_setup(&r);
+
+	sqe = ring_sqe(&r, XSC_OP_SENDMMSG, fds[0], 1);
+	sqe->addr = (uintptr_t)smsg;
+	sqe->len = 2;
+	ret = ring_run(&r);
+	report("SENDMMSG sends every message", ret == 2);
+
+	sqe = ring_sqe(&r, XSC_OP_RECVMMSG, fds[1], 2);
+	sqe->addr = (uintptr_t)rmsg;
+	sqe->len = 2;
+	ret = ring_run(&r);
+	ok = ret == 2;
+	for (i = 0; ok && i < 2; i++)
+		ok = rmsg[i].msg_len == sizeof(out[i]) &&
+		     !memcmp(in[i], out[i], sizeof(out[i]));
+	report("RECVMMSG round trip", ok);
+
+	ring_exit(&r);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int main(void)
+{
+	test_restricted_fixed_net();
+	test_msg_roundtrip();
+	test_msg_udp_segment();
+	test_mmsg_roundtrip();
+	return failures;
+}